@@ -9,8 +9,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "gpio.h"
+#include "bcm2708_btn.h"
 
 static
 void
@@ -29,6 +32,41 @@ delay ( unsigned int milisec )
 #define GPIO_BTN0   18
 #define GPIO_BTN1   23
 
+/* Device of the bcm2708_btn module (TME-3), loaded with gpios=18,23. */
+#define BTN_DEVICE  "/dev/bcm2708_btn"
+
+
+/*
+ * Same loop as below, on the debounced events of the module: the
+ * process sleeps in read() until a button changes, and each read()
+ * returns every pending event at once.
+ */
+static
+int
+wait_buttons ( int fd )
+{
+    struct bcm2708_btn_event ev[16];
+    ssize_t n;
+    int i;
+
+    for ( ;; ) {
+        n = read ( fd, ev, sizeof ( ev ) );
+        if ( n < 0 ) {
+            return -1;
+        }
+
+        for ( i = 0; i < n / ( int ) sizeof ( ev[0] ); i++ ) {
+            if ( ev[i].button == 0 ) {
+                printf ( "Changement de valeur : %d (%llu ns)\n", ev[i].pressed,
+                         ( unsigned long long ) ev[i].timestamp );
+            }
+            else if ( ev[i].button == 1 && ev[i].pressed ) {
+                return 0;
+            }
+        }
+    }
+}
+
 
 int
 main ( int argc, char **argv )
@@ -36,6 +74,15 @@ main ( int argc, char **argv )
     int period, half_period;
     int btn0, btn1,btn_tmp;
     int count;
+    int fd;
+
+    /* Interrupt-driven buttons when the module is loaded. */
+    fd = open ( BTN_DEVICE, O_RDONLY );
+    if ( fd >= 0 ) {
+        count = wait_buttons ( fd );
+        close ( fd );
+        return count;
+    }
 
     /* Retreive the mapped GPIO memory. */
     if(gpio_setup()==-1){
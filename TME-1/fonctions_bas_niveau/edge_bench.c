@@ -0,0 +1,437 @@
+/*
+ * Latence d'un front, de la sortie qui le produit jusqu'au programme
+ * qui le voit, pour chaque façon d'attendre une entrée :
+ *
+ *   poll   - lecture du niveau (GPLEV) en boucle, comme lab1.c
+ *   gpeds  - lecture en boucle du registre des fronts détectés (GPEDS),
+ *            qui n'en perd pas entre deux lectures
+ *   chip   - événements de /dev/gpiochipN (gpio_chip.h), sur interruption
+ *   kmod   - événements du module bcm2708_btn (TME-3), sur interruption ;
+ *            le charger avec gpios=<entrée> debounce=0
+ *
+ * Un fil produit les fronts sur la sortie, reliée à l'entrée par un fil
+ * volant, à intervalles aléatoires ; le fil mesuré les attend par le
+ * chemin choisi. Pour chaque chemin : histogramme des latences, temps
+ * processeur du fil mesuré, et pour chip et kmod la part passée avant
+ * la date prise par le noyau dans l'interruption.
+ *
+ * Avec -s, les registres sont simulés en mémoire et le fil producteur y
+ * écrit directement les fronts : seuls poll et gpeds ont un sens, et on
+ * mesure le coût logiciel de ces chemins, sans carte.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gpio.h"
+#include "bcm2708_btn.h"
+
+
+#define METHOD_POLL  0
+#define METHOD_GPEDS 1
+#define METHOD_CHIP  2
+#define METHOD_KMOD  3
+#define METHOD_NR    4
+
+static const char *method_name[] = {"poll", "gpeds", "chip", "kmod"};
+
+
+// Histogramme par puissance de deux de nanosecondes : la case i compte
+// [2^i, 2^(i+1)) ns, la dernière aussi les plus longues
+#define HIST_NR 32
+
+struct hist {
+  unsigned long count[HIST_NR];
+  unsigned long long total, max;
+};
+
+
+static int gpio_out = 17;
+static int gpio_in = 27;
+static int edges = 1000;
+static int gap = 1000;          // intervalle moyen entre deux fronts, en us
+static int poll_us = 0;         // pause entre deux lectures (0 : boucle active)
+static int fake = 0;
+static const char *chip_dev = "/dev/gpiochip0";
+static const char *btn_dev = "/dev/bcm2708_btn";
+
+// Date du dernier front produit et son numéro, puis le numéro du
+// dernier front vu par le fil mesuré
+static unsigned long long edge_ns;
+static unsigned int edge_seq, seen_seq;
+static int done;
+
+static struct gpio_chip *chip;
+static int btn_fd = -1;
+
+
+
+// Date courante en nanosecondes
+static unsigned long long now_ns(clockid_t clock){
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+static void hist_add(struct hist *h, unsigned long long ns){
+  unsigned long long x = ns;
+  int i = 0;
+
+  while(x > 1 && i < HIST_NR - 1){
+    x >>= 1;
+    i++;
+  }
+
+  h->count[i]++;
+  h->total += ns;
+  if(ns > h->max)
+    h->max = ns;
+}
+
+
+// Borne supérieure (ns) de la case qui contient le quantile "q"
+static unsigned long long hist_quantile(const struct hist *h, unsigned long n,
+                                        double q){
+  unsigned long sum = 0;
+  int i;
+
+  for(i=0;i<HIST_NR-1;i++){
+    sum += h->count[i];
+    if(sum >= q * n)
+      break;
+  }
+  return 2ull << i;
+}
+
+
+static void hist_print(const char *name, const struct hist *h){
+  unsigned long n = 0;
+  int i;
+
+  for(i=0;i<HIST_NR;i++)
+    n += h->count[i];
+  if(n == 0)
+    return;
+
+  printf("  %s: avg %llu ns, p50 < %llu ns, p99 < %llu ns, max %llu ns\n",
+         name, h->total / n, hist_quantile(h, n, 0.5),
+         hist_quantile(h, n, 0.99), h->max);
+  for(i=0;i<HIST_NR;i++){
+    if(h->count[i] > 0)
+      printf("    %s%10llu ns: %lu\n", i == HIST_NR - 1 ? ">=" : "< ",
+             i == HIST_NR - 1 ? 1ull << i : 2ull << i, h->count[i]);
+  }
+}
+
+
+
+// Produit un front sur la sortie ; en simulation, le contrôleur le
+// verrait sur l'entrée et le noterait dans GPEDS
+static void toggle(int level){
+  unsigned int bit = 1u << (gpio_in % 32);
+
+  if(!fake){
+    gpio_update(gpio_out, level);
+    return;
+  }
+
+  if(level)
+    __atomic_fetch_or(&addr_gpio[GPIO_LEV + gpio_in / 32], bit, __ATOMIC_SEQ_CST);
+  else
+    __atomic_fetch_and(&addr_gpio[GPIO_LEV + gpio_in / 32], ~bit, __ATOMIC_SEQ_CST);
+  __atomic_fetch_or(&addr_gpio[GPIO_EDS + gpio_in / 32], bit, __ATOMIC_SEQ_CST);
+}
+
+
+
+// Fil producteur : un front à intervalle aléatoire, après que le
+// précédent a été vu (ou au bout d'une seconde : il est perdu)
+static void *producer(void *arg){
+  unsigned long *missed = arg;
+  unsigned int r = 1;
+  unsigned long long t;
+  int i, level = 0;
+
+  for(i=1;i<=edges;i++){
+    usleep(gap / 2 + rand_r(&r) % (gap + 1));
+
+    level = !level;
+    __atomic_store_n(&edge_ns, now_ns(CLOCK_MONOTONIC), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&edge_seq, i, __ATOMIC_SEQ_CST);
+    toggle(level);
+
+    t = now_ns(CLOCK_MONOTONIC);
+    while(__atomic_load_n(&seen_seq, __ATOMIC_ACQUIRE) != (unsigned int)i){
+      if(now_ns(CLOCK_MONOTONIC) - t > 1000000000ull){
+        (*missed)++;
+        break;
+      }
+      usleep(100);
+    }
+  }
+
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+
+
+// Attend le prochain front (au plus 100 ms) par le chemin "method".
+// Rend 1 si un front est vu, 0 sinon, -1 en cas d'erreur ; "kernel_ns"
+// reçoit la date prise par le noyau, ou 0.
+static int wait_edge(int method, int *level, unsigned long long *kernel_ns){
+  unsigned long long deadline = now_ns(CLOCK_MONOTONIC) + 100000000ull;
+  unsigned long long events;
+  struct gpio_chip_event cev;
+  struct bcm2708_btn_event bev;
+  struct pollfd pfd;
+  int v, ret;
+
+  *kernel_ns = 0;
+
+  switch(method){
+  case METHOD_POLL:
+    do{
+      if(gpio_value(gpio_in, &v) == -1)
+        return -1;
+      if(v != *level){
+        *level = v;
+        return 1;
+      }
+      if(poll_us > 0)
+        usleep(poll_us);
+    }while(now_ns(CLOCK_MONOTONIC) < deadline);
+    return 0;
+
+  case METHOD_GPEDS:
+    do{
+      if(gpio_events(&events) == -1)
+        return -1;
+      // Registres simulés : l'écriture qui efface les bits n'y a pas
+      // d'effet, on l'imite
+      if(fake && events)
+        __atomic_fetch_and(&addr_gpio[GPIO_EDS + gpio_in / 32],
+                           ~(unsigned int)(events >> (gpio_in / 32 * 32)),
+                           __ATOMIC_SEQ_CST);
+      if(events >> gpio_in & 0x1)
+        return 1;
+      if(poll_us > 0)
+        usleep(poll_us);
+    }while(now_ns(CLOCK_MONOTONIC) < deadline);
+    return 0;
+
+  case METHOD_CHIP:
+    ret = gpio_chip_event(chip, &cev, 100);
+    if(ret == 1)
+      *kernel_ns = cev.timestamp;
+    return ret;
+
+  default:
+    pfd.fd = btn_fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, 100);
+    if(ret <= 0)
+      return ret;
+    if(read(btn_fd, &bev, sizeof(bev)) != sizeof(bev))
+      return -1;
+    *kernel_ns = bev.timestamp;
+    return 1;
+  }
+}
+
+
+
+// Prépare l'entrée pour le chemin "method" ; rend -1 s'il n'est pas
+// disponible
+static int method_open(int method){
+  switch(method){
+  case METHOD_POLL:
+    return 0;
+  case METHOD_GPEDS:
+    return fake ? 0 : gpio_config_edge(gpio_in, GPIO_EDGE_BOTH);
+  case METHOD_CHIP:
+    if(fake)
+      return -1;
+    chip = gpio_chip_open(chip_dev, 0, 1ULL << gpio_in, GPIO_EDGE_BOTH);
+    if(chip == NULL)
+      perror(chip_dev);
+    return chip == NULL ? -1 : 0;
+  default:
+    if(fake)
+      return -1;
+    btn_fd = open(btn_dev, O_RDONLY);
+    if(btn_fd < 0)
+      perror(btn_dev);
+    return btn_fd < 0 ? -1 : 0;
+  }
+}
+
+
+static void method_close(int method){
+  switch(method){
+  case METHOD_GPEDS:
+    if(!fake)
+      gpio_config_edge(gpio_in, 0);
+    break;
+  case METHOD_CHIP:
+    gpio_chip_close(chip);
+    chip = NULL;
+    break;
+  case METHOD_KMOD:
+    close(btn_fd);
+    btn_fd = -1;
+    break;
+  }
+}
+
+
+
+// Mesure d'un chemin : "edges" fronts
+static void run(int method){
+  struct hist lat, irq;
+  unsigned long long t0, t1, cpu, wall, kernel_ns, e;
+  unsigned long n = 0, missed = 0;
+  pthread_t tid;
+  int level, ret;
+
+  // Entrée au repos avant de commencer à l'écouter
+  toggle(0);
+  usleep(10000);
+  gpio_value(gpio_in, &level);
+
+  if(method_open(method) == -1){
+    printf("%s: not available\n", method_name[method]);
+    return;
+  }
+
+  if(fake)
+    addr_gpio[GPIO_EDS + gpio_in / 32] = 0;
+  else if(method == METHOD_GPEDS)
+    gpio_events(&e);
+
+  memset(&lat, 0, sizeof(lat));
+  memset(&irq, 0, sizeof(irq));
+
+  __atomic_store_n(&done, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&seen_seq, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&edge_seq, 0, __ATOMIC_RELAXED);
+
+  cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+  wall = now_ns(CLOCK_MONOTONIC);
+  pthread_create(&tid, NULL, producer, &missed);
+
+  while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE)){
+    ret = wait_edge(method, &level, &kernel_ns);
+    if(ret == -1){
+      perror(method_name[method]);
+      break;
+    }
+    if(ret == 0)
+      continue;
+
+    t1 = now_ns(CLOCK_MONOTONIC);
+    t0 = __atomic_load_n(&edge_ns, __ATOMIC_SEQ_CST);
+    hist_add(&lat, t1 - t0);
+    if(kernel_ns >= t0)
+      hist_add(&irq, kernel_ns - t0);
+    n++;
+    __atomic_store_n(&seen_seq, __atomic_load_n(&edge_seq, __ATOMIC_SEQ_CST),
+                     __ATOMIC_RELEASE);
+  }
+
+  pthread_join(tid, NULL);
+  cpu = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+  wall = now_ns(CLOCK_MONOTONIC) - wall;
+  method_close(method);
+
+  printf("%s%s: %lu edges seen, %lu missed, cpu %.1f%% (%.1f us per edge)\n",
+         method_name[method],
+         method <= METHOD_GPEDS ? (poll_us ? " (sleeping poll)" : " (busy loop)") : "",
+         n, missed, 100.0 * cpu / wall, n ? cpu / 1000.0 / n : 0.0);
+  hist_print("edge to program", &lat);
+  hist_print("edge to kernel timestamp", &irq);
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr,
+          "usage: %s [-o output gpio] [-i input gpio] [-n edges] [-g gap us]\n"
+          "          [-p poll us] [-d gpiochip] [-k btn device] [-s]\n"
+          "          [poll|gpeds|chip|kmod]...\n"
+          "  -p: pause between two reads of poll and gpeds (0: busy loop)\n"
+          "  -s: simulated registers, no board (poll and gpeds only)\n",
+          name);
+  exit(1);
+}
+
+
+
+int main(int argc, char *argv[]){
+  int opt, i, m;
+
+  while((opt = getopt(argc, argv, "o:i:n:g:p:d:k:s")) != -1){
+    switch(opt){
+    case 'o': gpio_out = atoi(optarg); break;
+    case 'i': gpio_in = atoi(optarg); break;
+    case 'n': edges = atoi(optarg); break;
+    case 'g': gap = atoi(optarg); break;
+    case 'p': poll_us = atoi(optarg); break;
+    case 'd': chip_dev = optarg; break;
+    case 'k': btn_dev = optarg; break;
+    case 's': fake = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  if(edges < 1 || gap < 1 || poll_us < 0 || gpio_in < 0 || gpio_in > 53 ||
+     gpio_out < 0 || gpio_out > 53)
+    usage(argv[0]);
+
+  if(fake)
+    addr_gpio = calloc(1024, sizeof(unsigned int));
+  else if(gpio_setup() == -1)
+    addr_gpio = NULL;
+  if(addr_gpio == NULL){
+    perror("gpio_setup");
+    return 1;
+  }
+
+  if(!fake && (gpio_config(gpio_out, GPIO_OUTPUT_PIN) == -1 ||
+               gpio_config(gpio_in, GPIO_INPUT_PIN) == -1)){
+    fprintf(stderr, "%s: cannot configure the pins\n", argv[0]);
+    return 1;
+  }
+
+  printf("output %d, input %d, %d edges every %d us on average%s\n",
+         gpio_out, gpio_in, edges, gap, fake ? ", simulated registers" : "");
+
+  if(optind == argc){
+    for(m=0;m<METHOD_NR;m++)
+      run(m);
+  }
+  for(i=optind;i<argc;i++){
+    for(m=0;m<METHOD_NR && strcmp(argv[i], method_name[m]) != 0;m++)
+      ;
+    if(m == METHOD_NR)
+      usage(argv[0]);
+    run(m);
+  }
+
+  if(!fake){
+    gpio_config(gpio_out, GPIO_INPUT_PIN);
+    gpio_teardown();
+  }
+
+  return 0;
+}
@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+/* Le Makefile définit HAVE_LINUX_GPIO_H si les en-têtes du noyau
+   fournissent l'API des lignes GPIO (v2 : noyau 5.10 et suivants) */
+#ifdef HAVE_LINUX_GPIO_H
+#include <linux/gpio.h>
+#endif
+
+#include "gpio_chip.h"
+
+
+#define GPIO_CHIP_LINES  64
+#define GPIO_CHIP_EVENTS 16
+
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+struct gpio_chip {
+  int fd;                                 /* requête de lignes */
+  int n;
+  unsigned int offsets[GPIO_CHIP_LINES];  /* ligne de chaque bit de la requête */
+  signed char index[GPIO_CHIP_LINES];     /* bit de la requête de chaque ligne */
+  struct gpio_v2_line_event events[GPIO_CHIP_EVENTS];
+  int head, count;                        /* événements lus, pas encore rendus */
+};
+
+
+
+/* Masque de lignes -> masque de bits de la requête */
+static int gpio_chip_bits(const struct gpio_chip *chip, unsigned long long lines,
+                          unsigned long long *bits){
+  int i;
+
+  *bits = 0;
+  for(i=0;i<GPIO_CHIP_LINES;i++){
+    if(!(lines & (1ULL << i)))
+      continue;
+    if(chip->index[i] < 0){
+      errno = EINVAL;
+      return -1;
+    }
+    *bits |= 1ULL << chip->index[i];
+  }
+
+  return 0;
+}
+
+
+
+struct gpio_chip *gpio_chip_open(const char *dev, unsigned long long outputs,
+                                 unsigned long long inputs, int edges){
+  struct gpio_v2_line_request req;
+  struct gpio_v2_line_config_attribute *attr;
+  struct gpio_chip *chip;
+  unsigned long long out;
+  int fd, i, err;
+
+  if(outputs & inputs){
+    errno = EINVAL;
+    return NULL;
+  }
+
+  chip = calloc(1, sizeof(*chip));
+  if(chip == NULL)
+    return NULL;
+
+  memset(&req, 0, sizeof(req));
+  memset(chip->index, -1, sizeof(chip->index));
+  for(i=0;i<GPIO_CHIP_LINES;i++){
+    if((outputs | inputs) & (1ULL << i)){
+      chip->index[i] = chip->n;
+      chip->offsets[chip->n] = i;
+      req.offsets[chip->n] = i;
+      chip->n++;
+    }
+  }
+
+  if(chip->n == 0){
+    free(chip);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* Par défaut, les lignes sont des entrées ; les sorties ont leurs
+     propres drapeaux et leur valeur initiale (0) */
+  req.num_lines = chip->n;
+  strncpy(req.consumer, "libgpio", sizeof(req.consumer) - 1);
+  req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+  if(edges & GPIO_EDGE_RISING)
+    req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+  if(edges & GPIO_EDGE_FALLING)
+    req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  req.event_buffer_size = edges ? GPIO_CHIP_EVENTS * 4 : 0;
+
+  gpio_chip_bits(chip, outputs, &out);
+  if(out){
+    attr = &req.config.attrs[req.config.num_attrs++];
+    attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    attr->attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    attr->mask = out;
+
+    attr = &req.config.attrs[req.config.num_attrs++];
+    attr->attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    attr->attr.values = 0;
+    attr->mask = out;
+  }
+
+  fd = open(dev, O_RDWR | O_CLOEXEC);
+  if(fd < 0){
+    free(chip);
+    return NULL;
+  }
+
+  err = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req);
+  close(fd);
+  if(err < 0){
+    free(chip);
+    return NULL;
+  }
+
+  chip->fd = req.fd;
+  return chip;
+}
+
+
+
+void gpio_chip_close(struct gpio_chip *chip){
+  if(chip == NULL)
+    return;
+
+  close(chip->fd);
+  free(chip);
+}
+
+
+
+int gpio_chip_update_mask(struct gpio_chip *chip, unsigned long long set,
+                          unsigned long long clear){
+  struct gpio_v2_line_values v;
+  unsigned long long s, c;
+
+  if(gpio_chip_bits(chip, set, &s) == -1 || gpio_chip_bits(chip, clear, &c) == -1)
+    return -1;
+
+  /* Les lignes hors du masque gardent leur valeur */
+  v.mask = s | c;
+  v.bits = s;
+  if(v.mask == 0)
+    return 0;
+
+  return ioctl(chip->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0 ? -1 : 0;
+}
+
+
+
+int gpio_chip_update(struct gpio_chip *chip, int gpio, int value){
+  unsigned long long line;
+
+  if(gpio < 0 || gpio >= GPIO_CHIP_LINES){
+    errno = EINVAL;
+    return -1;
+  }
+
+  line = 1ULL << gpio;
+  return gpio_chip_update_mask(chip, value ? line : 0, value ? 0 : line);
+}
+
+
+
+int gpio_chip_values(struct gpio_chip *chip, unsigned long long *levels){
+  struct gpio_v2_line_values v;
+  int i;
+
+  v.mask = chip->n == GPIO_CHIP_LINES ? ~0ULL : (1ULL << chip->n) - 1;
+  v.bits = 0;
+  if(ioctl(chip->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v) < 0)
+    return -1;
+
+  *levels = 0;
+  for(i=0;i<chip->n;i++){
+    if(v.bits & (1ULL << i))
+      *levels |= 1ULL << chip->offsets[i];
+  }
+
+  return 0;
+}
+
+
+
+int gpio_chip_value(struct gpio_chip *chip, int gpio, int *value){
+  unsigned long long levels;
+
+  if(gpio < 0 || gpio >= GPIO_CHIP_LINES || chip->index[gpio] < 0){
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(gpio_chip_values(chip, &levels) == -1)
+    return -1;
+
+  *value = (levels >> gpio) & 0x1;
+  return 0;
+}
+
+
+
+int gpio_chip_event(struct gpio_chip *chip, struct gpio_chip_event *ev,
+                    int timeout){
+  struct gpio_v2_line_event *e;
+  struct pollfd pfd;
+  ssize_t n;
+  int err;
+
+  /* Un seul read() pour tous les événements en attente */
+  if(chip->count == 0){
+    pfd.fd = chip->fd;
+    pfd.events = POLLIN;
+    do{
+      err = poll(&pfd, 1, timeout);
+    }while(err < 0 && errno == EINTR);
+    if(err <= 0)
+      return err;
+
+    n = read(chip->fd, chip->events, sizeof(chip->events));
+    if(n < (ssize_t)sizeof(chip->events[0]))
+      return -1;
+    chip->head = 0;
+    chip->count = n / sizeof(chip->events[0]);
+  }
+
+  e = &chip->events[chip->head++];
+  chip->count--;
+
+  ev->gpio = e->offset;
+  ev->rising = e->id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+  ev->timestamp = e->timestamp_ns;
+  ev->seqno = e->seqno;
+  return 1;
+}
+
+
+
+int gpio_chip_fd(const struct gpio_chip *chip){
+  return chip->fd;
+}
+
+
+int gpio_chip_pending(const struct gpio_chip *chip){
+  return chip->count;
+}
+
+
+#else
+
+/* Pas d'API des lignes GPIO dans les en-têtes : le module est vide */
+
+struct gpio_chip *gpio_chip_open(const char *dev, unsigned long long outputs,
+                                 unsigned long long inputs, int edges){
+  errno = ENOSYS;
+  return NULL;
+}
+
+void gpio_chip_close(struct gpio_chip *chip){
+}
+
+int gpio_chip_update_mask(struct gpio_chip *chip, unsigned long long set,
+                          unsigned long long clear){
+  errno = ENOSYS;
+  return -1;
+}
+
+int gpio_chip_update(struct gpio_chip *chip, int gpio, int value){
+  errno = ENOSYS;
+  return -1;
+}
+
+int gpio_chip_values(struct gpio_chip *chip, unsigned long long *levels){
+  errno = ENOSYS;
+  return -1;
+}
+
+int gpio_chip_value(struct gpio_chip *chip, int gpio, int *value){
+  errno = ENOSYS;
+  return -1;
+}
+
+int gpio_chip_event(struct gpio_chip *chip, struct gpio_chip_event *ev,
+                    int timeout){
+  errno = ENOSYS;
+  return -1;
+}
+
+int gpio_chip_fd(const struct gpio_chip *chip){
+  return -1;
+}
+
+int gpio_chip_pending(const struct gpio_chip *chip){
+  return 0;
+}
+
+#endif
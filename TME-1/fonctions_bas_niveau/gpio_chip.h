@@ -0,0 +1,92 @@
+#ifndef _GPIO_CHIP_H_
+#define _GPIO_CHIP_H_
+
+/*
+ * Lines of a GPIO character device (/dev/gpiochipN, uAPI v2).
+ *
+ * Unlike the /dev/mem mapping of gpio_setup(), this does not need root
+ * (only access to the device file) and the kernel arbitrates the lines
+ * between programs. All the lines a program uses are taken in a single
+ * request, so that several of them are set or read with one ioctl.
+ *
+ * Lines are designated by their offset on the chip (the GPIO number on
+ * the first chip of the Raspberry Pi), from 0 to 63; in the masks, bit
+ * 'n' stands for line 'n'.
+ */
+
+/* Edges reported on the input lines: GPIO_EDGE_* */
+#include "gpio_config.h"
+
+/* Edge event, timestamped by the kernel when the edge was detected. */
+struct gpio_chip_event {
+  int gpio;
+  int rising;                     /* 1: rising edge, 0: falling edge */
+  unsigned long long timestamp;   /* CLOCK_MONOTONIC, in ns */
+  unsigned int seqno;             /* number of the event on the request */
+};
+
+struct gpio_chip;
+
+/*
+ * Request the lines of 'outputs' as outputs, initially low, and those of
+ * 'inputs' as inputs reporting the edges 'edges' (0: no events).
+ * Return NULL in case of error (errno is set).
+ */
+
+struct gpio_chip *
+gpio_chip_open ( const char *dev, unsigned long long outputs,
+                 unsigned long long inputs, int edges );
+
+/*
+ * Release the lines.
+ */
+
+void
+gpio_chip_close ( struct gpio_chip *chip );
+
+/*
+ * Drive the lines of 'set' high and those of 'clear' low, with a single
+ * ioctl. Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_chip_update_mask ( struct gpio_chip *chip, unsigned long long set,
+                        unsigned long long clear );
+
+int
+gpio_chip_update ( struct gpio_chip *chip, int gpio, int value );
+
+/*
+ * Read the level of every requested line, with a single ioctl.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_chip_values ( struct gpio_chip *chip, unsigned long long *levels );
+
+int
+gpio_chip_value ( struct gpio_chip *chip, int gpio, int *value );
+
+/*
+ * Wait at most 'timeout' ms (-1: no limit) for the next edge event.
+ * Events are read from the kernel by batches and returned one by one.
+ * Return 1 if 'ev' is filled, 0 on timeout and -1 in case of error.
+ */
+
+int
+gpio_chip_event ( struct gpio_chip *chip, struct gpio_chip_event *ev,
+                  int timeout );
+
+/*
+ * File descriptor of the request, readable (poll) when events are
+ * pending in the kernel. Events already buffered by gpio_chip_event()
+ * are counted by gpio_chip_pending().
+ */
+
+int
+gpio_chip_fd ( const struct gpio_chip *chip );
+
+int
+gpio_chip_pending ( const struct gpio_chip *chip );
+
+#endif
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gpio_ring.h"
+#include "gpio_client.h"
+
+
+struct gpio_client {
+  int sock;                 /* connexion au démon : les lignes tant qu'elle est ouverte */
+  int doorbell, done;       /* eventfd vers le démon, et depuis le démon */
+  struct gpio_ring *ring;
+  unsigned int head;        /* copie locale de ring->head */
+};
+
+
+
+// Réception de la réponse du démon, et des descripteurs qui
+// l'accompagnent
+static int gpio_client_recv(int sock, int *status, int fds[3]){
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = status;
+  iov.iov_len = sizeof(*status);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if(recvmsg(sock, &msg, 0) != sizeof(*status))
+    return -1;
+
+  if(*status < 0)
+    return 0;
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+     cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))){
+    errno = EPROTO;
+    return -1;
+  }
+
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  return 0;
+}
+
+
+
+struct gpio_client *gpio_client_open(const char *path, unsigned long long outputs,
+                                     unsigned long long inputs){
+  struct sockaddr_un addr;
+  struct gpio_claim claim;
+  struct gpio_client *c;
+  int status, fds[3];
+  void *map;
+
+  c = calloc(1, sizeof(*c));
+  if(c == NULL)
+    return NULL;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path != NULL ? path : GPIO_DAEMON_SOCKET,
+          sizeof(addr.sun_path) - 1);
+
+  c->sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if(c->sock < 0)
+    goto free;
+
+  if(connect(c->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    goto close;
+
+  claim.outputs = outputs;
+  claim.inputs = inputs;
+  if(send(c->sock, &claim, sizeof(claim), 0) != sizeof(claim))
+    goto close;
+
+  if(gpio_client_recv(c->sock, &status, fds) == -1)
+    goto close;
+  if(status < 0){
+    errno = -status;
+    goto close;
+  }
+
+  map = mmap(NULL, sizeof(struct gpio_ring), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fds[0], 0);
+  close(fds[0]);
+  if(map == MAP_FAILED){
+    close(fds[1]);
+    close(fds[2]);
+    goto close;
+  }
+
+  c->ring = map;
+  c->doorbell = fds[1];
+  c->done = fds[2];
+  c->head = c->ring->head;
+  return c;
+
+close:
+  status = errno;
+  close(c->sock);
+  errno = status;
+free:
+  free(c);
+  return NULL;
+}
+
+
+
+// Attend que le démon ait exécuté les opérations jusqu'à "head" : on
+// annonce qu'on dort avant de revérifier, le démon écrit dans "done"
+// après avoir publié "tail"
+static int gpio_client_wait(struct gpio_client *c, unsigned int head){
+  uint64_t n;
+
+  for(;;){
+    if((int)(head - __atomic_load_n(&c->ring->tail, __ATOMIC_ACQUIRE)) <= 0)
+      return 0;
+
+    __atomic_store_n(&c->ring->client_waiting, 1, __ATOMIC_SEQ_CST);
+    if((int)(head - __atomic_load_n(&c->ring->tail, __ATOMIC_SEQ_CST)) <= 0){
+      __atomic_store_n(&c->ring->client_waiting, 0, __ATOMIC_RELAXED);
+      return 0;
+    }
+
+    if(read(c->done, &n, sizeof(n)) != sizeof(n) && errno != EINTR)
+      return -1;
+    __atomic_store_n(&c->ring->client_waiting, 0, __ATOMIC_RELAXED);
+  }
+}
+
+
+
+// Ajoute une opération dans l'anneau et réveille le démon s'il dort
+static int gpio_client_push(struct gpio_client *c, unsigned int type,
+                            unsigned long long set, unsigned long long clear){
+  struct gpio_op *op;
+  uint64_t one = 1;
+
+  // Anneau plein : on attend que le démon en ait vidé une case
+  if(c->head - __atomic_load_n(&c->ring->tail, __ATOMIC_ACQUIRE) >= GPIO_RING_SIZE &&
+     gpio_client_wait(c, c->head - GPIO_RING_SIZE + 1) == -1)
+    return -1;
+
+  op = &c->ring->ops[c->head % GPIO_RING_SIZE];
+  op->type = type;
+  op->set = set;
+  op->clear = clear;
+  c->head++;
+  __atomic_store_n(&c->ring->head, c->head, __ATOMIC_SEQ_CST);
+
+  if(__atomic_load_n(&c->ring->daemon_idle, __ATOMIC_SEQ_CST) &&
+     write(c->doorbell, &one, sizeof(one)) != sizeof(one))
+    return -1;
+
+  return 0;
+}
+
+
+
+void gpio_client_close(struct gpio_client *c){
+  if(c == NULL)
+    return;
+
+  gpio_client_wait(c, c->head);
+  munmap(c->ring, sizeof(*c->ring));
+  close(c->doorbell);
+  close(c->done);
+  close(c->sock);
+  free(c);
+}
+
+
+
+int gpio_client_update_mask(struct gpio_client *c, unsigned long long set,
+                            unsigned long long clear){
+  if((set | clear) == 0)
+    return 0;
+
+  return gpio_client_push(c, GPIO_OP_UPDATE, set, clear);
+}
+
+
+
+int gpio_client_update(struct gpio_client *c, int gpio, int value){
+  unsigned long long line;
+
+  if(gpio < 0 || gpio > 53){
+    errno = EINVAL;
+    return -1;
+  }
+
+  line = 1ULL << gpio;
+  return gpio_client_update_mask(c, value ? line : 0, value ? 0 : line);
+}
+
+
+
+int gpio_client_sync(struct gpio_client *c){
+  return gpio_client_wait(c, c->head);
+}
+
+
+
+int gpio_client_values(struct gpio_client *c, unsigned long long *levels){
+  if(gpio_client_push(c, GPIO_OP_READ, 0, 0) == -1 ||
+     gpio_client_wait(c, c->head) == -1)
+    return -1;
+
+  *levels = c->ring->levels;
+  return 0;
+}
+
+
+
+int gpio_client_value(struct gpio_client *c, int gpio, int *value){
+  unsigned long long levels;
+
+  if(gpio < 0 || gpio > 53){
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(gpio_client_values(c, &levels) == -1)
+    return -1;
+
+  *value = (levels >> gpio) & 0x1;
+  return 0;
+}
+
+
+
+unsigned int gpio_client_rejected(const struct gpio_client *c){
+  return c->ring->rejected;
+}
@@ -0,0 +1,80 @@
+#ifndef _GPIO_CLIENT_H_
+#define _GPIO_CLIENT_H_
+
+/*
+ * GPIO lines through gpio_daemon, which owns the /dev/mem mapping.
+ *
+ * Each client owns the lines it claims: the daemon refuses lines
+ * already claimed by another client and ignores operations on lines the
+ * client does not own. Operations are queued in a shared-memory ring
+ * and executed in order; the daemon merges operations of different
+ * clients into one GPSET and one GPCLR write per bank whenever they do
+ * not touch the same line twice, but never two operations of the same
+ * client, so that a data line set before a clock edge stays before it.
+ *
+ * Lines 0 to 53; in the masks, bit 'n' stands for GPIO 'n'. A client
+ * must not be used by several threads at once.
+ */
+
+struct gpio_client;
+
+/*
+ * Connect to the daemon listening on 'path' (NULL: GPIO_DAEMON_SOCKET)
+ * and claim the lines of 'outputs' as outputs and those of 'inputs' as
+ * inputs. Return NULL in case of error (errno is set, EBUSY if a line
+ * belongs to another client).
+ */
+
+struct gpio_client *
+gpio_client_open ( const char *path, unsigned long long outputs,
+                   unsigned long long inputs );
+
+/*
+ * Wait for the queued operations, then release the lines.
+ */
+
+void
+gpio_client_close ( struct gpio_client *c );
+
+/*
+ * Queue the update of the lines of 'set' (high) and 'clear' (low).
+ * Return once the operation is in the ring, not once it is executed;
+ * blocks only when the ring is full. Return -1 in case of error, 0
+ * otherwise.
+ */
+
+int
+gpio_client_update_mask ( struct gpio_client *c, unsigned long long set,
+                          unsigned long long clear );
+
+int
+gpio_client_update ( struct gpio_client *c, int gpio, int value );
+
+/*
+ * Wait until every queued operation has been executed.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_client_sync ( struct gpio_client *c );
+
+/*
+ * Read the levels of the claimed lines, after the queued operations.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_client_values ( struct gpio_client *c, unsigned long long *levels );
+
+int
+gpio_client_value ( struct gpio_client *c, int gpio, int *value );
+
+/*
+ * Operations the daemon ignored because they touched lines the client
+ * does not own.
+ */
+
+unsigned int
+gpio_client_rejected ( const struct gpio_client *c );
+
+#endif
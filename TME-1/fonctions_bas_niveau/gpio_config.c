@@ -1,8 +1,56 @@
+#include <stddef.h>
+
 #include "gpio_setup.h"
 #include "gpio_config.h"
 
 int gpio_config( int gpio, int value){
 
-  *(addr_gpio) |= ( 0x1 << ( 3 * gpio ));
+  volatile unsigned int *fsel;
+  int shift;
+
+  if(addr_gpio == NULL || gpio < 0 || gpio > 53)
+    return -1;
+
+  fsel = addr_gpio + GPIO_FSEL + gpio / 10;
+  shift = 3 * ( gpio % 10 );
+
+  switch(value){
+  case GPIO_INPUT_PIN:
+    *fsel &= ~( 0x7 << shift );
+    break;
+  case GPIO_OUTPUT_PIN:
+    *fsel = ( *fsel & ~( 0x7 << shift )) | ( 0x1 << shift );
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+int gpio_config_edge( int gpio, int edges){
+
+  unsigned int bit;
+
+  if(addr_gpio == NULL || gpio < 0 || gpio > 53 || edges & ~GPIO_EDGE_BOTH)
+    return -1;
+
+  bit = 1u << ( gpio % 32 );
+
+  if(edges & GPIO_EDGE_RISING)
+    addr_gpio[GPIO_REN + gpio / 32] |= bit;
+  else
+    addr_gpio[GPIO_REN + gpio / 32] &= ~bit;
+
+  if(edges & GPIO_EDGE_FALLING)
+    addr_gpio[GPIO_FEN + gpio / 32] |= bit;
+  else
+    addr_gpio[GPIO_FEN + gpio / 32] &= ~bit;
+
+  /* Pas d'événement antérieur à la configuration */
+  addr_gpio[GPIO_EDS + gpio / 32] = bit;
 
+  return 0;
 }
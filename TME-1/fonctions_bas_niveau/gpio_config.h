@@ -4,6 +4,11 @@
 #define GPIO_INPUT_PIN      1
 #define GPIO_OUTPUT_PIN     2
 
+/* Edges detected on an input (gpio_config_edge(), gpio_chip_open()). */
+#define GPIO_EDGE_RISING  0x1
+#define GPIO_EDGE_FALLING 0x2
+#define GPIO_EDGE_BOTH    ( GPIO_EDGE_RISING | GPIO_EDGE_FALLING )
+
 /*
  * Configure the GPIO pin as input or output.
  * Return -1 in case of error, 0 otherwise.
@@ -12,5 +17,16 @@
 int
 gpio_config ( int gpio, int value );
 
+/*
+ * Latch the 'edges' of the GPIO (0: none) in the event detect status
+ * register, see gpio_events(). Only for lines no kernel driver uses:
+ * the kernel handles the GPIO interrupt, and may see and clear the
+ * events first.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_config_edge ( int gpio, int edges );
+
 #endif
 
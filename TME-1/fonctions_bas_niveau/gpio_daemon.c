@@ -0,0 +1,502 @@
+/*
+ * gpio_daemon : seul propriétaire de la projection du contrôleur GPIO,
+ * il sert les programmes clients (gpio_client.h) par des anneaux
+ * d'opérations en mémoire partagée.
+ *
+ * Chaque client possède les lignes qu'il a réservées. À chaque tour, le
+ * démon vide les anneaux de tous ses clients en prenant une opération
+ * de chacun à la fois : les opérations de clients différents sont
+ * regroupées en une écriture de GPSET et une de GPCLR par banc, mais
+ * deux opérations d'un même client ne le sont jamais, pour que ses
+ * fronts restent dans l'ordre (une donnée avant son horloge). Une
+ * opération qui touche une ligne déjà modifiée force aussi l'écriture.
+ * Sans travail, il dort dans poll() ; sinon, les arrivées et les départs
+ * sont vérifiés sans attendre après chaque tour.
+ *
+ * L'anneau est écrit par le client : le démon garde sa propre position
+ * de lecture et ne croit "head" qu'à GPIO_RING_SIZE opérations près.
+ *
+ * usage : gpio_daemon [-s socket] [-f]
+ *   -f : registres simulés en mémoire, pour essayer sans /dev/mem
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "gpio.h"
+#include "gpio_ring.h"
+
+
+#define MAX_CLIENTS 16
+#define GPIO_LINES  0x3fffffffffffffULL   /* GPIO 0 à 53 */
+
+
+struct client {
+  int sock, doorbell, done;
+  struct gpio_ring *ring;
+  unsigned int tail;        /* opérations exécutées : ring->tail n'en est qu'une copie */
+  unsigned long long outputs, inputs;
+};
+
+static struct client clients[MAX_CLIENTS];
+static int nclients;
+
+// Lignes réservées par l'ensemble des clients
+static unsigned long long owned;
+
+// Écritures en attente du tour courant, par banc
+static unsigned int pending_set[GPIO_BANKS], pending_clr[GPIO_BANKS];
+
+// Registres simulés (-f)
+static int fake;
+
+// Statistiques
+static unsigned long long nops, nwrites, nrounds;
+
+static volatile sig_atomic_t stop;
+
+// Attente maximale de la demande d'un nouveau client
+static const struct timeval claim_timeout = {0, 100000};
+
+
+
+static void on_signal(int sig){
+  stop = 1;
+}
+
+
+
+// Écrit les mises à jour en attente : une écriture par registre et
+// par banc
+static void flush(void){
+  int b;
+
+  for(b=0;b<GPIO_BANKS;b++){
+    if(pending_set[b]){
+      addr_gpio[GPIO_SET + b] = pending_set[b];
+      nwrites++;
+    }
+    if(pending_clr[b]){
+      addr_gpio[GPIO_CLR + b] = pending_clr[b];
+      nwrites++;
+    }
+    if(fake)
+      addr_gpio[GPIO_LEV + b] = (addr_gpio[GPIO_LEV + b] | pending_set[b]) & ~pending_clr[b];
+
+    pending_set[b] = 0;
+    pending_clr[b] = 0;
+  }
+}
+
+
+
+// Ajoute une mise à jour au tour courant
+static void update(unsigned long long set, unsigned long long clear){
+  unsigned int s, c;
+  int b;
+
+  for(b=0;b<GPIO_BANKS;b++){
+    s = set >> (32 * b);
+    c = clear >> (32 * b);
+    if((s | c) & (pending_set[b] | pending_clr[b]))
+      flush();
+  }
+
+  for(b=0;b<GPIO_BANKS;b++){
+    pending_set[b] |= (unsigned int)(set >> (32 * b));
+    pending_clr[b] |= (unsigned int)(clear >> (32 * b));
+  }
+}
+
+
+
+// Niveaux des lignes, après les écritures en attente
+static unsigned long long levels(void){
+  flush();
+  return addr_gpio[GPIO_LEV] | (unsigned long long)addr_gpio[GPIO_LEV + 1] << 32;
+}
+
+
+
+// Opérations en attente dans l'anneau du client : "head" est écrit par
+// le client, on n'en croit pas plus que la taille de l'anneau
+static unsigned int queued(const struct client *cl){
+  unsigned int n = __atomic_load_n(&cl->ring->head, __ATOMIC_ACQUIRE) - cl->tail;
+
+  return n > GPIO_RING_SIZE ? GPIO_RING_SIZE : n;
+}
+
+
+
+// Exécute l'opération suivante d'un client dans le tour courant
+static void execute(struct client *cl){
+  struct gpio_op op;
+  unsigned long long mask;
+
+  // Copie : le client peut réécrire la case pendant qu'on la lit
+  memcpy(&op, &cl->ring->ops[cl->tail++ % GPIO_RING_SIZE], sizeof(op));
+  nops++;
+
+  if(op.type == GPIO_OP_READ){
+    cl->ring->levels = levels() & (cl->outputs | cl->inputs);
+    return;
+  }
+
+  // Les lignes des autres clients ne sont pas touchées
+  mask = op.set | op.clear;
+  if(op.type != GPIO_OP_UPDATE || (mask & ~cl->outputs)){
+    cl->ring->rejected++;
+    mask &= cl->outputs;
+  }
+  update(op.set & mask, op.clear & mask & ~op.set);
+}
+
+
+
+// Un tour : les anneaux de tous les clients, une opération de chacun à
+// la fois, les registres écrits après chaque passage pour qu'un client
+// n'ait jamais deux opérations dans la même écriture, puis les réveils.
+// Les "tail" sont publiés après l'écriture des registres.
+static int round_robin(void){
+  unsigned int left[MAX_CLIENTS], ran[MAX_CLIENTS];
+  uint64_t one = 1;
+  int i, more, work = 0;
+
+  for(i=0;i<nclients;i++)
+    left[i] = ran[i] = queued(&clients[i]);
+
+  do{
+    more = 0;
+    for(i=0;i<nclients;i++){
+      if(left[i] == 0)
+        continue;
+      execute(&clients[i]);
+      left[i]--;
+      more = work = 1;
+    }
+    flush();
+  }while(more);
+
+  if(!work)
+    return 0;
+
+  nrounds++;
+
+  for(i=0;i<nclients;i++){
+    if(ran[i] == 0)
+      continue;
+    __atomic_store_n(&clients[i].ring->tail, clients[i].tail, __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&clients[i].ring->client_waiting, __ATOMIC_SEQ_CST) &&
+       write(clients[i].done, &one, sizeof(one)) != sizeof(one))
+      perror("write");
+  }
+
+  return 1;
+}
+
+
+
+// Configure des lignes
+static void config(unsigned long long lines, int mode){
+  int i;
+
+  for(i=0;i<54;i++){
+    if(lines & (1ULL << i))
+      gpio_config(i, mode);
+  }
+}
+
+
+
+// Envoi de la réponse à un client, avec ses descripteurs si elle vaut 0
+static int reply(int sock, int status, const int *fds){
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &status;
+  iov.iov_len = sizeof(status);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if(status == 0){
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+  }
+
+  return sendmsg(sock, &msg, 0) == sizeof(status) ? 0 : -1;
+}
+
+
+
+// Nouveau client : réservation de ses lignes, anneau et eventfd
+static void accept_client(int server){
+  struct gpio_claim claim;
+  struct client *cl;
+  char name[64];
+  int sock, shm, fds[3];
+  void *map;
+
+  sock = accept(server, NULL, NULL);
+  if(sock < 0)
+    return;
+
+  // Un client qui n'envoie pas sa demande ne bloque pas le démon
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &claim_timeout, sizeof(claim_timeout));
+
+  if(recv(sock, &claim, sizeof(claim), 0) != sizeof(claim)){
+    close(sock);
+    return;
+  }
+
+  if(nclients == MAX_CLIENTS){
+    reply(sock, -EAGAIN, NULL);
+    close(sock);
+    return;
+  }
+
+  if((claim.outputs & claim.inputs) || ((claim.outputs | claim.inputs) & ~GPIO_LINES)){
+    reply(sock, -EINVAL, NULL);
+    close(sock);
+    return;
+  }
+
+  if((claim.outputs | claim.inputs) & owned){
+    reply(sock, -EBUSY, NULL);
+    close(sock);
+    return;
+  }
+
+  // Objet de mémoire partagée sans nom : il ne vit que par les
+  // descripteurs et les projections
+  snprintf(name, sizeof(name), "/gpio_daemon.%d.%d", (int)getpid(), sock);
+  shm = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(shm < 0){
+    reply(sock, -errno, NULL);
+    close(sock);
+    return;
+  }
+  shm_unlink(name);
+
+  cl = &clients[nclients];
+  memset(cl, 0, sizeof(*cl));
+  map = MAP_FAILED;
+  cl->doorbell = eventfd(0, EFD_NONBLOCK);
+  cl->done = eventfd(0, 0);
+  if(ftruncate(shm, sizeof(struct gpio_ring)) == 0)
+    map = mmap(NULL, sizeof(struct gpio_ring), PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+
+  if(cl->doorbell < 0 || cl->done < 0 || map == MAP_FAILED){
+    reply(sock, -ENOMEM, NULL);
+    if(map != MAP_FAILED)
+      munmap(map, sizeof(struct gpio_ring));
+    close(cl->doorbell);
+    close(cl->done);
+    close(shm);
+    close(sock);
+    return;
+  }
+
+  fds[0] = shm;
+  fds[1] = cl->doorbell;
+  fds[2] = cl->done;
+  if(reply(sock, 0, fds) == -1){
+    munmap(map, sizeof(struct gpio_ring));
+    close(cl->doorbell);
+    close(cl->done);
+    close(shm);
+    close(sock);
+    return;
+  }
+  close(shm);
+
+  cl->sock = sock;
+  cl->ring = map;
+  cl->outputs = claim.outputs;
+  cl->inputs = claim.inputs;
+  owned |= claim.outputs | claim.inputs;
+  config(claim.outputs, GPIO_OUTPUT_PIN);
+  config(claim.inputs, GPIO_INPUT_PIN);
+  nclients++;
+}
+
+
+
+// Client parti : ses opérations restantes sont exécutées, puis ses
+// lignes repassent en entrée
+static void remove_client(int i){
+  struct client *cl = &clients[i];
+  unsigned int n;
+
+  for(n=queued(cl);n>0;n--){
+    execute(cl);
+    flush();
+  }
+
+  config(cl->outputs, GPIO_INPUT_PIN);
+  owned &= ~(cl->outputs | cl->inputs);
+
+  munmap(cl->ring, sizeof(*cl->ring));
+  close(cl->doorbell);
+  close(cl->done);
+  close(cl->sock);
+
+  clients[i] = clients[--nclients];
+}
+
+
+
+// Attente d'au plus "timeout" ms sur le socket d'écoute, ceux des
+// clients et leurs "doorbell", puis départs et arrivées
+static void poll_clients(int server, int timeout){
+  struct pollfd pfd[1 + 2 * MAX_CLIENTS];
+  uint64_t n;
+  int i;
+
+  pfd[0].fd = server;
+  pfd[0].events = POLLIN;
+  for(i=0;i<nclients;i++){
+    pfd[1 + 2 * i].fd = clients[i].sock;
+    pfd[1 + 2 * i].events = POLLIN;
+    pfd[2 + 2 * i].fd = clients[i].doorbell;
+    pfd[2 + 2 * i].events = POLLIN;
+  }
+
+  if(poll(pfd, 1 + 2 * nclients, timeout) <= 0)
+    return;
+
+  for(i=0;i<nclients;i++){
+    if((pfd[2 + 2 * i].revents & POLLIN) &&
+       read(clients[i].doorbell, &n, sizeof(n)) < 0 && errno != EAGAIN)
+      perror("read");
+  }
+
+  // Départs (du dernier au premier : remove_client() déplace le
+  // dernier client), puis arrivées
+  for(i=nclients-1;i>=0;i--){
+    if(pfd[1 + 2 * i].revents)
+      remove_client(i);
+  }
+  if(pfd[0].revents & POLLIN)
+    accept_client(server);
+}
+
+
+
+// Sommeil : on annonce qu'on dort avant de revérifier les anneaux, les
+// clients sonnent alors "doorbell"
+static void wait_work(int server){
+  int i, idle = 1;
+
+  for(i=0;i<nclients;i++)
+    __atomic_store_n(&clients[i].ring->daemon_idle, 1, __ATOMIC_SEQ_CST);
+  for(i=0;i<nclients;i++){
+    if(__atomic_load_n(&clients[i].ring->head, __ATOMIC_SEQ_CST) != clients[i].tail)
+      idle = 0;
+  }
+
+  if(idle)
+    poll_clients(server, -1);
+
+  for(i=0;i<nclients;i++)
+    __atomic_store_n(&clients[i].ring->daemon_idle, 0, __ATOMIC_SEQ_CST);
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr, "usage: %s [-s socket] [-f]\n", name);
+  exit(1);
+}
+
+
+// Fonction principale
+int main(int argc, char *argv[]){
+  const char *path = GPIO_DAEMON_SOCKET;
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  int server, opt;
+
+  while((opt = getopt(argc, argv, "s:f")) != -1){
+    switch(opt){
+    case 's': path = optarg; break;
+    case 'f': fake = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  if(fake)
+    addr_gpio = calloc(1024, sizeof(unsigned int));
+  else if(gpio_setup() == -1)
+    addr_gpio = NULL;
+  if(addr_gpio == NULL){
+    perror("gpio_setup");
+    return 1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+
+  server = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if(server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     listen(server, MAX_CLIENTS) < 0){
+    perror(path);
+    return 1;
+  }
+
+  // Les clients n'ont pas besoin d'être root : le groupe du socket
+  // décide qui peut se connecter
+  chmod(path, 0660);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Arrivées et départs aussi après chaque tour : un client qui garde
+  // son anneau plein ne fait attendre ni les nouveaux clients, ni la
+  // libération des lignes d'un client parti
+  while(!stop){
+    if(round_robin())
+      poll_clients(server, 0);
+    else
+      wait_work(server);
+  }
+
+  while(nclients > 0)
+    remove_client(nclients - 1);
+  close(server);
+  unlink(path);
+
+  printf("%llu operations, %llu register writes, %llu rounds\n", nops, nwrites, nrounds);
+
+  if(!fake)
+    gpio_teardown();
+
+  return 0;
+}
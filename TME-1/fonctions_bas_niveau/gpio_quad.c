@@ -0,0 +1,119 @@
+#include <stddef.h>
+
+#include "gpio_value.h"
+#include "gpio_quad.h"
+
+
+/* Pas pour chaque transition (état précédent << 2 | état courant),
+   dans le sens 00 -> 01 -> 11 -> 10 -> 00 */
+static const signed char gpio_quad_step[16] = {
+   0,  1, -1,  0,
+  -1,  0,  0,  1,
+   1,  0,  0, -1,
+   0, -1,  1,  0,
+};
+
+/* Transitions où les deux canaux ont changé : un échantillon manqué */
+static const unsigned char gpio_quad_skip[16] = {
+  0, 0, 0, 1,
+  0, 0, 1, 0,
+  0, 1, 0, 0,
+  1, 0, 0, 0,
+};
+
+
+
+int gpio_quad_init(struct gpio_quad *q, const int *a, const int *b, int n){
+  int i;
+
+  if(n < 1 || n > GPIO_QUAD_MAX)
+    return -1;
+
+  q->n = n;
+  q->started = 0;
+  q->levels = 0;
+  for(i=0;i<n;i++){
+    if(a[i] < 0 || a[i] > 53 || b[i] < 0 || b[i] > 53)
+      return -1;
+    q->enc[i].a = a[i];
+    q->enc[i].b = b[i];
+    q->enc[i].state = 0;
+    q->enc[i].dir = 1;
+    q->enc[i].position = 0;
+    q->enc[i].skips = 0;
+  }
+
+  return 0;
+}
+
+
+
+void gpio_quad_update(struct gpio_quad *q, unsigned long long levels){
+  struct gpio_quad_encoder *e;
+  unsigned int cur, t;
+  int i, step;
+
+  for(i=0;i<q->n;i++){
+    e = &q->enc[i];
+    cur = (levels >> e->a & 0x1) << 1 | (levels >> e->b & 0x1);
+
+    // Premier échantillon : l'état de départ, sans pas
+    t = q->started ? e->state << 2 | cur : cur << 2 | cur;
+    step = gpio_quad_step[t] + 2 * e->dir * gpio_quad_skip[t];
+
+    e->skips += gpio_quad_skip[t];
+    e->dir = step > 0 ? 1 : step < 0 ? -1 : e->dir;
+    e->state = cur;
+
+    // Un seul écrivain : les lecteurs voient l'ancienne ou la nouvelle
+    // position, jamais un mélange
+    __atomic_store_n(&e->position, e->position + step, __ATOMIC_RELEASE);
+  }
+
+  q->levels = levels;
+  q->started = 1;
+}
+
+
+
+int gpio_quad_poll(struct gpio_quad *q){
+  unsigned long long levels;
+
+  if(gpio_values(&levels) == -1)
+    return -1;
+
+  gpio_quad_update(q, levels);
+  return 0;
+}
+
+
+
+int gpio_quad_events(struct gpio_quad *q, struct gpio_chip *chip, int timeout){
+  struct gpio_chip_event ev;
+  unsigned long long levels, line;
+  int n = 0, ret;
+
+  if(!q->started){
+    if(gpio_chip_values(chip, &levels) == -1)
+      return -1;
+    gpio_quad_update(q, levels);
+  }
+
+  // Un front à la fois : jamais deux canaux qui changent ensemble
+  for(ret=gpio_chip_event(chip, &ev, timeout);ret==1;ret=gpio_chip_event(chip, &ev, 0)){
+    line = 1ULL << ev.gpio;
+    gpio_quad_update(q, ev.rising ? q->levels | line : q->levels & ~line);
+    n++;
+
+    if(gpio_chip_pending(chip) == 0)
+      break;
+  }
+
+  return ret < 0 ? -1 : n;
+}
+
+
+
+long gpio_quad_position(const struct gpio_quad *q, int i){
+  return __atomic_load_n(&q->enc[i].position, __ATOMIC_ACQUIRE);
+}
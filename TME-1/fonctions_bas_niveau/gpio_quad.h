@@ -0,0 +1,82 @@
+#ifndef _GPIO_QUAD_H_
+#define _GPIO_QUAD_H_
+
+/*
+ * Quadrature (rotary encoder) decoder.
+ *
+ * All the encoders are decoded from one snapshot of the levels (bit 'n'
+ * for GPIO 'n'), with a transition table indexed by the previous and
+ * the current state of the two channels: no test per pin. A transition
+ * where both channels changed means a sample was missed; it is counted
+ * as two steps in the last direction of the encoder instead of being
+ * dropped, so a fast spin keeps its count as long as fewer than two
+ * steps are missed between samples.
+ *
+ * The snapshots come either from a polling loop (gpio_quad_poll(), on
+ * the /dev/mem mapping) or from the edge events of a gpiochip line
+ * request (gpio_quad_events()). A single thread updates the decoder;
+ * any thread may read the positions, without locking.
+ */
+
+#include "gpio_chip.h"
+
+/* Maximal number of encoders per decoder */
+#define GPIO_QUAD_MAX 16
+
+struct gpio_quad_encoder {
+  int a, b;                 /* GPIO of channels A and B */
+  unsigned int state;       /* last (A << 1 | B) */
+  int dir;                  /* last direction: 1 or -1 */
+  long position;            /* 4 counts per full cycle */
+  unsigned long skips;      /* missed samples, compensated */
+};
+
+struct gpio_quad {
+  int n;
+  int started;
+  unsigned long long levels;
+  struct gpio_quad_encoder enc[GPIO_QUAD_MAX];
+};
+
+/*
+ * Set up 'q' for 'n' encoders, encoder 'i' on GPIO a[i] and b[i].
+ * Positions start at 0 with the first snapshot.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_quad_init ( struct gpio_quad *q, const int *a, const int *b, int n );
+
+/*
+ * Decode the snapshot 'levels'.
+ */
+
+void
+gpio_quad_update ( struct gpio_quad *q, unsigned long long levels );
+
+/*
+ * Take one snapshot of the GPIO controller (gpio_values()) and decode
+ * it. Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_quad_poll ( struct gpio_quad *q );
+
+/*
+ * Wait at most 'timeout' ms for edge events on 'chip', whose request
+ * must watch both edges of every channel, then decode every pending
+ * event. The first call samples the lines. Return the number of events
+ * decoded, or -1 in case of error.
+ */
+
+int
+gpio_quad_events ( struct gpio_quad *q, struct gpio_chip *chip, int timeout );
+
+/*
+ * Position of encoder 'i', from any thread.
+ */
+
+long
+gpio_quad_position ( const struct gpio_quad *q, int i );
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _GPIO_RING_H_
+#define _GPIO_RING_H_
+
+/*
+ * Protocol between gpio_daemon and its clients (gpio_client.h).
+ *
+ * A client connects to the daemon's UNIX socket and sends a
+ * struct gpio_claim. If none of its lines belongs to another client,
+ * the daemon answers 0 along with three file descriptors: a shared
+ * memory object holding a struct gpio_ring, the "doorbell" eventfd
+ * (client -> daemon) and the "done" eventfd (daemon -> client).
+ * Otherwise it answers a negative errno value. The socket stays open
+ * afterwards: when it closes, the lines are released.
+ *
+ * The ring has a single producer (the client) and a single consumer
+ * (the daemon). An eventfd is only written when the other side has
+ * announced it is about to sleep, so a busy client pays no system call
+ * per operation.
+ */
+
+#define GPIO_DAEMON_SOCKET "/run/gpio_daemon.sock"
+
+/* Operations per ring (power of 2) */
+#define GPIO_RING_SIZE 256
+
+/* Banks of the controller: GPIO 0 to 31, and 32 to 53 */
+#define GPIO_BANKS 2
+
+#define GPIO_OP_UPDATE 0   /* drive 'set' high and 'clear' low */
+#define GPIO_OP_READ   1   /* sample the levels into 'levels' */
+
+struct gpio_claim {
+  unsigned long long outputs;
+  unsigned long long inputs;
+};
+
+struct gpio_op {
+  unsigned long long set, clear;
+  unsigned int type;
+};
+
+struct gpio_ring {
+  /* Written by the client */
+  unsigned int head __attribute__ ((aligned (64)));   /* operations queued */
+  unsigned int client_waiting;                        /* sleeping on "done" */
+
+  /* Written by the daemon */
+  unsigned int tail __attribute__ ((aligned (64)));   /* operations executed */
+  unsigned int daemon_idle;                           /* ring the doorbell */
+  unsigned int rejected;                              /* lines not owned */
+  unsigned long long levels;                          /* last GPIO_OP_READ */
+
+  struct gpio_op ops[GPIO_RING_SIZE] __attribute__ ((aligned (64)));
+};
+
+#endif
@@ -1,23 +1,48 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "gpio_setup.h"
 
 
+/* Adresse physique du contrôleur GPIO du BCM2708 */
+#define GPIO_BASE 0x20200000
+#define GPIO_SIZE 4096
+
+
+volatile unsigned int *addr_gpio;
 
 
 int gpio_setup(void){
 
-addr_gpio = mmap(NULL,
-       4096,
+  void *map;
+  int fd;
+
+  fd = open("/dev/mem", O_RDWR | O_SYNC);
+  if(fd < 0)
+    return -1;
+
+  map = mmap(NULL,
+       GPIO_SIZE,
        PROT_READ | PROT_WRITE,
-       MAP_PRIVATE,
-       "/dev/meme",
-       0x20200000
+       MAP_SHARED,
+       fd,
+       GPIO_BASE
     );
 
+  close(fd);
+
+  if(map == MAP_FAILED)
+    return -1;
+
+  addr_gpio = map;
+  return 0;
 }
 
 
 void gpio_teardown(void){
 
-  munmap(addr_gpio,4096);
+  munmap((void *)addr_gpio,GPIO_SIZE);
+  addr_gpio = NULL;
 
 }
@@ -11,7 +11,16 @@
  */
 
 
-void *addr_gpio;
+/* Registres du contrôleur GPIO (index en mots de 32 bits) */
+#define GPIO_FSEL    0    /* GPFSEL0 : choix de fonction, 10 broches par mot */
+#define GPIO_SET     7    /* GPSET0  : mise à 1 des sorties */
+#define GPIO_CLR     10   /* GPCLR0  : mise à 0 des sorties */
+#define GPIO_LEV     13   /* GPLEV0  : niveau des broches */
+#define GPIO_EDS     16   /* GPEDS0  : fronts détectés, remis à 0 en écrivant 1 */
+#define GPIO_REN     19   /* GPREN0  : détection des fronts montants */
+#define GPIO_FEN     22   /* GPFEN0  : détection des fronts descendants */
+
+extern volatile unsigned int *addr_gpio;
 
 int
 gpio_setup ( void );
@@ -0,0 +1,186 @@
+/*
+ * gpio_stress : charge et vérification de gpio_daemon.
+ *
+ * Chaque client (un processus) réserve deux lignes de sortie, une
+ * "donnée" et une "horloge", et envoie des opérations qui les font
+ * basculer chacune à leur tour, comme un bus série. À la fin, il relit
+ * ses lignes, vérifie qu'aucune opération n'a été refusée, puis qu'une
+ * opération sur une ligne qu'il ne possède pas l'est bien. Pendant ce
+ * temps, un client de plus se connecte, part, puis revient sur les mêmes
+ * lignes : le démon doit le servir sans attendre que les autres se
+ * taisent. Le démon affiche en sortant le nombre d'opérations et
+ * d'écritures de registre.
+ *
+ * usage : gpio_stress [-s socket] [-c clients] [-n opérations]
+ *   par exemple, avec "gpio_daemon -f -s /tmp/gpio.sock" lancé à côté
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "gpio.h"
+
+
+#define MAX_CLIENTS 15   // le démon en sert 16 : un de plus arrive en cours de route
+#define LATE_MAX_MS 1000
+
+
+static const char *path = NULL;
+static int nclients = 4;
+static int nops = 100000;
+
+
+
+// Date courante en microsecondes
+static unsigned long long now_us(void){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+// Un client : lignes 2k+2 (donnée) et 2k+3 (horloge). Rend le nombre
+// d'erreurs constatées.
+static int client(int k){
+  unsigned long long data = 1ULL << (2 * k + 2), clk = data << 1;
+  unsigned long long levels, want = 0;
+  struct gpio_client *c;
+  int i, errors = 0;
+
+  c = gpio_client_open(path, data | clk, 0);
+  if(c == NULL){
+    perror("gpio_client_open");
+    return 1;
+  }
+
+  // Donnée puis horloge, en alternance : chaque opération change une
+  // seule ligne
+  for(i=0;i<nops;i++){
+    if(i % 2 == 0){
+      want ^= data;
+      gpio_client_update_mask(c, want & data, ~want & data);
+    }
+    else{
+      want ^= clk;
+      gpio_client_update_mask(c, want & clk, ~want & clk);
+    }
+  }
+
+  if(gpio_client_values(c, &levels) == -1 || levels != want){
+    fprintf(stderr, "client %d: levels %#llx instead of %#llx\n", k, levels, want);
+    errors++;
+  }
+  if(gpio_client_rejected(c) != 0){
+    fprintf(stderr, "client %d: %u operations rejected\n", k, gpio_client_rejected(c));
+    errors++;
+  }
+
+  // Ligne qu'il ne possède pas : refusée
+  gpio_client_update_mask(c, 1ULL << 53, 0);
+  if(gpio_client_sync(c) == -1 || gpio_client_rejected(c) != 1){
+    fprintf(stderr, "client %d: foreign line not rejected\n", k);
+    errors++;
+  }
+
+  gpio_client_close(c);
+  return errors;
+}
+
+
+
+// Client arrivé pendant la charge : connexion, départ, puis retour sur
+// les mêmes lignes, qui doivent avoir été libérées. Rend le nombre
+// d'erreurs constatées.
+static int late_client(void){
+  unsigned long long lines = 3ULL << (2 * nclients + 2), start, ms, connect_ms;
+  struct gpio_client *c;
+  int tries;
+
+  start = now_us();
+  c = gpio_client_open(path, lines, 0);
+  connect_ms = (now_us() - start) / 1000;
+  if(c == NULL || connect_ms > LATE_MAX_MS){
+    fprintf(stderr, "late client: %s after %llu ms\n", c ? "connected" : "refused",
+            connect_ms);
+    if(c != NULL)
+      gpio_client_close(c);
+    return 1;
+  }
+  gpio_client_close(c);
+
+  // Le départ est vu au tour suivant du démon
+  start = now_us();
+  for(tries=0;tries<100;tries++){
+    c = gpio_client_open(path, lines, 0);
+    if(c != NULL)
+      break;
+    usleep(LATE_MAX_MS * 10);
+  }
+  ms = (now_us() - start) / 1000;
+  if(c == NULL){
+    fprintf(stderr, "late client: lines still owned %llu ms after leaving\n", ms);
+    return 1;
+  }
+  gpio_client_close(c);
+
+  printf("late client: connected in %llu ms, lines freed in %llu ms\n", connect_ms, ms);
+  return 0;
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr, "usage: %s [-s socket] [-c clients (1-%d)] [-n operations]\n",
+          name, MAX_CLIENTS);
+  exit(1);
+}
+
+
+int main(int argc, char *argv[]){
+  unsigned long long start, elapsed;
+  int opt, i, status, failed = 0;
+
+  while((opt = getopt(argc, argv, "s:c:n:")) != -1){
+    switch(opt){
+    case 's': path = optarg; break;
+    case 'c': nclients = atoi(optarg); break;
+    case 'n': nops = atoi(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+
+  if(nclients < 1 || nclients > MAX_CLIENTS || nops < 1)
+    usage(argv[0]);
+
+  start = now_us();
+  for(i=0;i<nclients;i++){
+    switch(fork()){
+    case -1:
+      perror("fork");
+      return 1;
+    case 0:
+      _exit(client(i) ? 1 : 0);
+    }
+  }
+
+  // Les clients ont commencé leur charge
+  usleep(20000);
+  failed += late_client();
+
+  while(wait(&status) > 0){
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed++;
+  }
+  elapsed = now_us() - start;
+
+  printf("%d clients x %d operations in %llu ms (%.0f operations/s), %d failed\n",
+         nclients, nops, elapsed / 1000, (double)nclients * nops * 1e6 / elapsed,
+         failed);
+
+  return failed > 0;
+}
@@ -1,3 +1,6 @@
+#include <stddef.h>
+
+#include "gpio_setup.h"
 #include "gpio_value.h"
 
 
@@ -6,13 +9,70 @@
 
 int gpio_value(int gpio, int * value){
 
+  if(addr_gpio == NULL || gpio < 0 || gpio > 53)
+    return -1;
 
+  *value = ( addr_gpio[GPIO_LEV + gpio / 32] >> ( gpio % 32 )) & 0x1;
+  return 0;
+}
+
+
+
+int gpio_values(unsigned long long * levels){
+
+  if(addr_gpio == NULL)
+    return -1;
+
+  *levels = addr_gpio[GPIO_LEV] | ( unsigned long long ) addr_gpio[GPIO_LEV + 1] << 32;
+  return 0;
+}
+
+
+
+int gpio_events(unsigned long long * events){
+
+  unsigned int eds[2];
+
+  if(addr_gpio == NULL)
+    return -1;
+
+  /* Un bit à 1 efface l'événement : on n'efface que ceux qu'on a lus,
+     un front arrivé entre les deux accès reste en attente */
+  eds[0] = addr_gpio[GPIO_EDS];
+  eds[1] = addr_gpio[GPIO_EDS + 1];
+  if(eds[0])
+    addr_gpio[GPIO_EDS] = eds[0];
+  if(eds[1])
+    addr_gpio[GPIO_EDS + 1] = eds[1];
+
+  *events = eds[0] | ( unsigned long long ) eds[1] << 32;
+  return 0;
 }
 
 
 
 int gpio_update( int gpio, int value){
 
+  if(addr_gpio == NULL || gpio < 0 || gpio > 53)
+    return -1;
+
+  addr_gpio[( value ? GPIO_SET : GPIO_CLR ) + gpio / 32] = 1 << ( gpio % 32 );
+  return 0;
+}
+
+
+
+int gpio_update_mask( unsigned int set, unsigned int clear){
+
+  if(addr_gpio == NULL)
+    return -1;
 
+  /* Une écriture dans GPSET0 puis une dans GPCLR0 : les bits à 0
+     de chaque registre laissent les autres broches inchangées */
+  if(set)
+    addr_gpio[GPIO_SET] = set;
+  if(clear)
+    addr_gpio[GPIO_CLR] = clear;
 
+  return 0;
 }
@@ -4,6 +4,9 @@
 #include "gpio_setup.h"
 #include "gpio_config.h"
 #include "gpio_value.h"
+#include "gpio_chip.h"
+#include "gpio_client.h"
+#include "gpio_quad.h"
 
 #endif
 
@@ -8,6 +8,25 @@
 int
 gpio_value ( int gpio, int * value );
 
+/*
+ * Snapshot of the levels of GPIO 0 to 53, one read of GPLEV0 and one
+ * of GPLEV1: bit 'n' of 'levels' is the level of GPIO 'n'.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_values ( unsigned long long * levels );
+
+/*
+ * Take the edges latched since the last call (see gpio_config_edge()):
+ * bit 'n' of 'events' is set if an edge was detected on GPIO 'n'. The
+ * returned events are cleared in GPEDS0 and GPEDS1.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_events ( unsigned long long * events );
+
 /*
  * Update the value of the GPIO (if output).
  * Output value if zero if 'value' == 0, 1 otherwise.
@@ -16,5 +35,15 @@ gpio_value ( int gpio, int * value );
 int
 gpio_update ( int gpio, int value );
 
+/*
+ * Update several outputs of the first bank (GPIO 0 to 31) at once.
+ * Bit 'n' of 'set' drives GPIO 'n' high and bit 'n' of 'clear' drives
+ * it low, with a single write to GPSET0 and a single write to GPCLR0.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+gpio_update_mask ( unsigned int set, unsigned int clear );
+
 #endif
 
@@ -0,0 +1,567 @@
+/*
+ * liblcd: protocole HD44780, indépendant du transport.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "lcd.h"
+
+
+// Contenu du fichier d'état laissé par lcd_detach()
+#define LCD_STATE_MAGIC 0x4c434431
+
+struct lcd_state {
+  unsigned int magic;
+  int bus;
+  unsigned char ddram[2 * LCD_DDRAM_LINE];
+  unsigned char ac;
+  unsigned char entry;
+  int shift;
+};
+
+
+// Adresse de début de chacune des deux lignes de la DDRAM
+static const unsigned char ddram_line[] = {0x00, 0x40};
+
+// Adresse de début de chaque ligne de l'écran 4x20
+static const unsigned char row_offset[] = {0x00, 0x40, 0x14, 0x54};
+
+
+
+// Horloge virtuelle : les attentes avancent une date simulée au lieu
+// d'endormir le processus
+static int lcd_virtual;
+static unsigned long long lcd_virtual_us;
+
+
+
+// Attente de "x" microsecondes
+void lcd_udelay(unsigned int x){
+  if(lcd_virtual)
+    lcd_virtual_us += x;
+  else
+    usleep(x);
+}
+
+
+
+// Date courante en microsecondes
+unsigned long long lcd_now_us(void){
+  struct timespec ts;
+
+  if(lcd_virtual)
+    return lcd_virtual_us;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+// Passage à l'horloge virtuelle (ou retour à l'horloge réelle) ; la
+// date virtuelle part de la date réelle, pour rester croissante
+void lcd_clock_virtual(int on){
+  if(on && !lcd_virtual)
+    lcd_virtual_us = lcd_now_us();
+  lcd_virtual = on;
+}
+
+
+
+// L'afficheur est occupé pendant encore "x" microsecondes
+static void lcd_busy(struct lcd *lcd, unsigned int x){
+  unsigned long long t;
+
+  // L'autre extrémité du transport attend elle-même l'exécution
+  if(lcd->t->flags & LCD_TRANSPORT_PACED)
+    return;
+
+  t = lcd_now_us() + x;
+  if(t > lcd->ready)
+    lcd->ready = t;
+}
+
+
+
+// Attend que l'afficheur soit prêt
+static void lcd_wait(struct lcd *lcd){
+  unsigned long long now = lcd_now_us();
+
+  if(lcd->ready > now)
+    lcd_udelay(lcd->ready - now);
+}
+
+
+
+// Envoie l'opération en tête de file, avec les suivantes de même RS
+// tant que le transport les accepte en un seul appel
+static void lcd_issue(struct lcd *lcd, size_t max){
+  struct lcd_transport *t = lcd->t;
+  unsigned char buf[LCD_QUEUE];
+  struct lcd_op *head = &lcd->queue[lcd->head];
+  struct lcd_op *op;
+  unsigned int wait;
+  size_t len;
+
+  if(head->nibble_only){
+    t->write_nibble(t, lcd->display, head->value);
+    wait = head->wait;
+    len = 1;
+  }
+  else{
+    len = 0;
+    for(;;){
+      op = &lcd->queue[(lcd->head + len) % LCD_QUEUE];
+      buf[len++] = op->value;
+      wait = op->wait;
+
+      // Le transport n'attend entre deux octets que le temps
+      // d'une commande ordinaire
+      if(len == max || len == (size_t)lcd->count || wait != LCD_WAIT_CMD)
+        break;
+
+      op = &lcd->queue[(lcd->head + len) % LCD_QUEUE];
+      if(op->nibble_only || op->rs != head->rs)
+        break;
+    }
+    t->write(t, lcd->display, head->rs, buf, len);
+  }
+
+  lcd->head = (lcd->head + len) % LCD_QUEUE;
+  lcd->count -= len;
+  lcd->sent += len;
+  lcd_busy(lcd, wait);
+}
+
+
+
+// Vide les files des "n" afficheurs en entrelaçant leurs opérations :
+// on sert toujours l'afficheur prêt le plus tôt, de sorte que le temps
+// d'exécution d'un afficheur est mis à profit pour écrire sur les autres
+void lcd_schedule(struct lcd *lcd, int n){
+  struct lcd *next;
+  size_t max;
+  int i;
+
+  // Avec plusieurs afficheurs, on n'envoie qu'un octet à la fois
+  // pour pouvoir intercaler les autres pendant l'exécution
+  max = lcd->t->burst;
+  if(n > 1 && !(lcd->t->flags & LCD_TRANSPORT_PACED))
+    max = 1;
+
+  for(;;){
+    next = NULL;
+    for(i=0;i<n;i++){
+      if(lcd[i].count > 0 && (next == NULL || lcd[i].ready < next->ready))
+        next = &lcd[i];
+    }
+
+    if(next == NULL)
+      return;
+
+    lcd_wait(next);
+    lcd_issue(next, max);
+  }
+}
+
+
+
+// Envoie la file de l'afficheur et attend qu'il soit libre
+void lcd_sync(struct lcd *lcd){
+  lcd_schedule(lcd, 1);
+  lcd_wait(lcd);
+
+  if(lcd->t->sync != NULL)
+    lcd->t->sync(lcd->t, lcd->display);
+}
+
+
+
+// Compteur d'adresse dans la CGRAM : les données ne touchent pas la DDRAM
+#define LCD_AC_CGRAM 0xff
+
+
+// Index dans la copie de la DDRAM de l'adresse "addr"
+static unsigned char lcd_index(unsigned char addr){
+  return (addr & 0x40 ? LCD_DDRAM_LINE : 0) + (addr & 0x3f) % LCD_DDRAM_LINE;
+}
+
+
+// Déplacement du compteur d'adresse d'une case : après 0x27 vient 0x40,
+// et après 0x67 vient 0x00
+static void lcd_shadow_move(struct lcd *lcd, int right){
+  if(lcd->ac == LCD_AC_CGRAM)
+    return;
+
+  lcd->ac = (lcd->ac + (right ? 1 : 2 * LCD_DDRAM_LINE - 1)) % (2 * LCD_DDRAM_LINE);
+}
+
+
+// Effet de l'opération sur la copie de l'état du contrôleur
+static void lcd_shadow(struct lcd *lcd, unsigned char rs, unsigned char value){
+  if(rs == RS_DATA){
+    if(lcd->ac != LCD_AC_CGRAM)
+      lcd->ddram[lcd->ac] = value;
+    lcd_shadow_move(lcd, lcd->entry & CMD_ENTRY_ID);
+    if(lcd->entry & CMD_ENTRY_S)
+      lcd->shift += lcd->entry & CMD_ENTRY_ID ? 1 : -1;
+  }
+  else if(value & CMD_DDRAM){
+    lcd->ac = lcd_index(value & ~CMD_DDRAM);
+  }
+  else if(value & CMD_CGRAM){
+    lcd->ac = LCD_AC_CGRAM;
+  }
+  else if(value & CMD_FUNC){
+    // Pas d'effet sur le contenu
+  }
+  else if(value & CMD_CDSHIFT){
+    if(value & CMD_CDSHIFT_SC)
+      lcd->shift += value & CMD_CDSHIFT_RL ? -1 : 1;
+    else
+      lcd_shadow_move(lcd, value & CMD_CDSHIFT_RL);
+  }
+  else if(value & CMD_DISPLAY_ON_OFF){
+    // Pas d'effet sur le contenu
+  }
+  else if(value & CMD_ENTRY){
+    lcd->entry = value;
+  }
+  else if(value & CMD_CURSOR_HOME){
+    lcd->ac = 0;
+    lcd->shift = 0;
+  }
+  else if(value & CMD_CLEAR){
+    memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+    lcd->ac = 0;
+    lcd->entry |= CMD_ENTRY_ID;
+    lcd->shift = 0;
+  }
+}
+
+
+
+// Ajoute une opération dans la file de l'afficheur
+static void lcd_queue(struct lcd *lcd, unsigned char rs,
+                      unsigned char nibble_only, unsigned char value,
+                      unsigned int wait){
+  struct lcd_op *op;
+
+  // File pleine : on la vide sans attendre les autres afficheurs
+  if(lcd->count == LCD_QUEUE)
+    lcd_schedule(lcd, 1);
+
+  op = &lcd->queue[(lcd->head + lcd->count) % LCD_QUEUE];
+  op->rs = rs;
+  op->nibble_only = nibble_only;
+  op->value = value;
+  op->wait = wait;
+  lcd->count++;
+
+  if(!nibble_only)
+    lcd_shadow(lcd, rs, value);
+}
+
+
+
+// Mise en file d'une commande sur 8 bits
+void lcd_queue_cmd(struct lcd *lcd, unsigned char cmd, unsigned int wait){
+  lcd_queue(lcd, RS_CMD, 0, cmd, wait);
+}
+
+
+// Mise en file de données sur 8 bits
+void lcd_queue_data(struct lcd *lcd, unsigned char c){
+  lcd_queue(lcd, RS_DATA, 0, c, LCD_WAIT_CMD);
+}
+
+
+// Mise en file d'une chaîne de caractères
+void lcd_queue_string(struct lcd *lcd, const char *s, size_t len){
+  while(len-- > 0){
+    lcd_queue_data(lcd, *s++);
+  }
+}
+
+
+// Positionne le compteur d'adresse de la DDRAM
+void lcd_set_ddram(struct lcd *lcd, unsigned char addr){
+  lcd_queue_cmd(lcd, CMD_DDRAM | addr, LCD_WAIT_CMD);
+}
+
+
+// Positionne le curseur sur la ligne "row", colonne "col" de l'écran
+void lcd_set_position(struct lcd *lcd, int row, int col){
+  lcd_set_ddram(lcd, row_offset[row] + col);
+}
+
+
+// Envoie la commande "Cursor home", qui annule aussi le décalage de l'affichage
+void lcd_home(struct lcd *lcd){
+  lcd_queue_cmd(lcd, CMD_CURSOR_HOME, LCD_WAIT_CLEAR);
+}
+
+
+// Envoie la commande "Clear display" à l'écran lcd
+void lcd_clear(struct lcd *lcd){
+  lcd_queue_cmd(lcd, CMD_CLEAR, LCD_WAIT_CLEAR);
+}
+
+
+// Configuration de l'écran LCD et nettoyage du LCD.
+// La séquence est seulement mise en file : lcd_schedule() l'envoie,
+// en l'entrelaçant avec celle des autres afficheurs.
+void lcd_config_clear(struct lcd *lcd){
+
+  unsigned char func = CMD_FUNC | CMD_FUNC_DL;
+
+  // Séquence de réinitialisation, seulement si le transport sait
+  // envoyer un demi-octet : sinon (pilote noyau), le contrôleur est
+  // déjà configuré par le transport
+  if ( lcd->t->write_nibble != NULL ) {
+
+    // Envoie d'une commande pour la configuration sur
+    // 8 bits */
+    lcd_queue ( lcd, RS_CMD, 1, func >> 4, 100 );
+    lcd_queue ( lcd, RS_CMD, 1, func >> 4, 100 );
+    lcd_queue ( lcd, RS_CMD, 1, func >> 4, 100 );
+
+    /* 4 bits */
+    if ( lcd->t->bus == LCD_BUS_4BIT ) {
+      func = CMD_FUNC;
+      lcd_queue ( lcd, RS_CMD, 1, func >> 4, LCD_WAIT_CLEAR );
+    }
+
+    /* 2 rows on LCD */
+    func |= CMD_FUNC_N;
+    lcd_queue_cmd ( lcd, func, 100 );
+  }
+
+  /* Entry mode. */
+  lcd_queue_cmd ( lcd, CMD_ENTRY | CMD_ENTRY_ID, 100 );
+
+  /* Display on */
+  lcd_queue_cmd ( lcd, CMD_DISPLAY_ON_OFF | CMD_DISPLAY_ON_OFF_D, 100 );
+
+  /* Cursor */
+  lcd_queue_cmd ( lcd, CMD_CDSHIFT | CMD_CDSHIFT_RL, 100 );
+
+  /* Clear */
+  lcd_clear(lcd);
+}
+
+
+
+// Association d'un afficheur du transport, et mise en file de sa
+// séquence d'initialisation
+void lcd_open(struct lcd *lcd, struct lcd_transport *t, int display){
+  memset(lcd, 0, sizeof(*lcd));
+  lcd->t = t;
+  lcd->display = display;
+
+  lcd_config_clear(lcd);
+}
+
+
+
+// Nettoyage de l'afficheur
+void lcd_close(struct lcd *lcd){
+  lcd_clear(lcd);
+  lcd_sync(lcd);
+}
+
+
+
+// Association à chaud : on reprend l'état laissé par lcd_detach() au
+// lieu de réinitialiser et d'effacer l'afficheur. Le fichier est
+// d'abord renommé, de sorte qu'un seul programme le récupère.
+int lcd_attach(struct lcd *lcd, struct lcd_transport *t, int display,
+               const char *path){
+  struct lcd_state st;
+  char claim[sizeof(lcd->state) + 16];
+  ssize_t n = 0;
+  int fd;
+
+  memset(lcd, 0, sizeof(*lcd));
+  lcd->t = t;
+  lcd->display = display;
+
+  if(path != NULL)
+    snprintf(lcd->state, sizeof(lcd->state), "%s", path);
+  else
+    snprintf(lcd->state, sizeof(lcd->state), LCD_STATE_DIR "/lcd-%s-%d.state",
+             t->name, display);
+
+  snprintf(claim, sizeof(claim), "%s.%d", lcd->state, (int)getpid());
+  if(rename(lcd->state, claim) == 0){
+    fd = open(claim, O_RDONLY);
+    if(fd >= 0){
+      n = read(fd, &st, sizeof(st));
+      close(fd);
+    }
+    unlink(claim);
+  }
+
+  if(n != sizeof(st) || st.magic != LCD_STATE_MAGIC || st.bus != t->bus ||
+     (st.ac >= sizeof(lcd->ddram) && st.ac != LCD_AC_CGRAM)){
+    lcd_config_clear(lcd);
+    return 0;
+  }
+
+  memcpy(lcd->ddram, st.ddram, sizeof(lcd->ddram));
+  lcd->ac = st.ac;
+  lcd->entry = st.entry;
+  lcd->shift = st.shift;
+
+  // lcd_update() suppose l'affichage non décalé
+  if(lcd->shift != 0)
+    lcd_home(lcd);
+
+  return 1;
+}
+
+
+
+// Sauvegarde de l'état pour le prochain lcd_attach(), sans effacer
+// l'afficheur. Le fichier est écrit à côté puis renommé : on ne laisse
+// jamais un état à moitié écrit.
+int lcd_detach(struct lcd *lcd){
+  struct lcd_state st;
+  char tmp[sizeof(lcd->state) + 16];
+  int fd, ret;
+
+  lcd_sync(lcd);
+
+  if(lcd->state[0] == '\0')
+    return 0;
+
+  memset(&st, 0, sizeof(st));
+  st.magic = LCD_STATE_MAGIC;
+  st.bus = lcd->t->bus;
+  memcpy(st.ddram, lcd->ddram, sizeof(st.ddram));
+  st.ac = lcd->ac;
+  st.entry = lcd->entry;
+  st.shift = lcd->shift;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d", lcd->state, (int)getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return -1;
+
+  ret = write(fd, &st, sizeof(st)) == sizeof(st) ? 0 : -1;
+  if(close(fd) < 0)
+    ret = -1;
+  if(ret == 0)
+    ret = rename(tmp, lcd->state);
+  if(ret == -1)
+    unlink(tmp);
+
+  return ret;
+}
+
+
+
+// Écrit seulement les cases qui diffèrent de la copie de la DDRAM ;
+// l'adresse n'est renvoyée qu'au début de chaque suite de cases modifiées
+void lcd_update(struct lcd *lcd, int row, int col, const char *s, size_t len){
+  unsigned char addr = row_offset[row] + col;
+  unsigned char i;
+
+  // Les écritures doivent avancer le curseur sans décaler l'affichage
+  if(lcd->entry != (CMD_ENTRY | CMD_ENTRY_ID))
+    lcd_queue_cmd(lcd, CMD_ENTRY | CMD_ENTRY_ID, LCD_WAIT_CMD);
+
+  while(len-- > 0){
+    i = lcd_index(addr);
+    if(lcd->ddram[i] != (unsigned char)*s){
+      if(lcd->ac != i)
+        lcd_set_ddram(lcd, addr);
+      lcd_queue_data(lcd, *s);
+    }
+
+    s++;
+    addr = (addr & 0x40) | (lcd_index(addr) + 1) % LCD_DDRAM_LINE;
+  }
+}
+
+
+
+// Caractère que doit contenir la case "col" de la DDRAM : au pas "step",
+// la case visible en position p affiche text[step + p], et cette somme
+// ne change pas tant que la case reste hors de l'écran
+static char marquee_cell(const struct lcd_marquee *m, int col){
+  unsigned long p = (col + LCD_DDRAM_LINE - m->step % LCD_DDRAM_LINE)
+                    % LCD_DDRAM_LINE;
+
+  return m->text[(m->step + p) % m->len];
+}
+
+
+// Réécrit les cases "first" à "first + n - 1" de la ligne, avec une seule
+// commande d'adresse par portion contiguë de la DDRAM
+static void marquee_write(const struct lcd_marquee *m, unsigned long first,
+                          int n){
+  int col = first % LCD_DDRAM_LINE;
+
+  lcd_set_ddram(m->lcd, ddram_line[m->line] + col);
+  while(n-- > 0){
+    lcd_queue_data(m->lcd, marquee_cell(m, col));
+
+    // L'adresse 0x27 n'est pas suivie de 0x00 : on repositionne
+    if(++col == LCD_DDRAM_LINE && n > 0){
+      col = 0;
+      lcd_set_ddram(m->lcd, ddram_line[m->line]);
+    }
+  }
+}
+
+
+// Charge la ligne complète et annule le décalage de l'affichage
+void lcd_marquee_init(struct lcd_marquee *m, struct lcd *lcd, int line,
+                      const char *text, size_t len){
+  m->lcd = lcd;
+  m->text = text;
+  m->len = len;
+  m->line = line;
+  m->step = 0;
+  m->pending = 0;
+
+  lcd_home(lcd);
+  marquee_write(m, 0, LCD_DDRAM_LINE);
+}
+
+
+// Décale le texte d'une case vers la gauche.
+// Coût : un octet de commande, plus un paquet de 20 cases tous les 20 pas
+// (soit environ deux octets par pas au lieu de 20).
+void lcd_marquee_step(struct lcd_marquee *m){
+  lcd_queue_cmd(m->lcd, CMD_CDSHIFT | CMD_CDSHIFT_SC, LCD_WAIT_CMD);
+  m->step++;
+
+  // Si la longueur du texte divise 40, la ligne est déjà périodique
+  if(LCD_DDRAM_LINE % m->len == 0)
+    return;
+
+  // La plus ancienne case sortie réapparaît au prochain pas :
+  // on réécrit toutes les cases hors de l'écran en un seul paquet
+  if(++m->pending == LCD_DDRAM_LINE - LCD_COLS){
+    marquee_write(m, m->step + LCD_COLS, m->pending);
+    m->pending = 0;
+  }
+}
+
+
+
+// Fermeture d'un transport
+void lcd_transport_close(struct lcd_transport *t){
+  if(t != NULL)
+    t->close(t);
+}
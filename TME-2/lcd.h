@@ -0,0 +1,341 @@
+#ifndef _LCD_H_
+#define _LCD_H_
+
+#include <stddef.h>
+
+/*
+ * liblcd: HD44780 protocol shared by every user-mode LCD program.
+ *
+ * The protocol layer queues commands and data per display and hands
+ * them to a transport, which moves them to the controller: directly
+ * through the mmap'ed GPIO controller, through the bcm2708_lcd kernel
+ * driver, or to a simulated controller.
+ */
+
+
+/* RS signal: command or data. */
+#define RS_CMD  0
+#define RS_DATA 1
+
+/* Width of the data bus. */
+#define LCD_BUS_4BIT 4
+#define LCD_BUS_8BIT 8
+
+/* "Function set": DL - data length, N - number of lines, F - font. */
+#define CMD_FUNC     0x20
+#define CMD_FUNC_DL  0x10
+#define CMD_FUNC_N   0x8
+#define CMD_FUNC_F   0x4
+
+/* "Entry mode set": I/D - cursor direction, S - shift the display. */
+#define CMD_ENTRY    0x4
+#define CMD_ENTRY_ID 0x2
+#define CMD_ENTRY_S  0x1
+
+/* "Display on/off control": D - display on. */
+#define CMD_DISPLAY_ON_OFF   0x8
+#define CMD_DISPLAY_ON_OFF_D 0x4
+
+/* "Cursor/display shift": S/C - shift the display, R/L - to the right. */
+#define CMD_CDSHIFT    0x10
+#define CMD_CDSHIFT_RL 0x4
+#define CMD_CDSHIFT_SC 0x8
+
+#define CMD_CLEAR       0x1
+#define CMD_CURSOR_HOME 0x2
+#define CMD_CGRAM       0x40
+#define CMD_DDRAM       0x80
+
+/* Execution time (us) of an ordinary command and of "Clear"/"Home". */
+#define LCD_WAIT_CMD   50
+#define LCD_WAIT_CLEAR 2000
+
+/* Geometry: 4 rows of 20 characters over two 40-cell DDRAM lines. */
+#define LCD_ROWS       4
+#define LCD_COLS       20
+#define LCD_DDRAM_LINE 40
+
+/* Maximal number of displays on one transport. */
+#define LCD_MAX_DISPLAYS 8
+
+/* Maximal number of pending operations per display. */
+#define LCD_QUEUE 128
+
+/* Directory of the state files of lcd_attach() (a tmpfs, emptied at boot). */
+#define LCD_STATE_DIR "/run"
+
+
+/*
+ * A transport moves bytes from the protocol layer to the displays.
+ *
+ * 'write' sends 'len' bytes (at most 'burst') with the given RS to one
+ * display; consecutive bytes are separated by the execution time of an
+ * ordinary command, and the wait after the last one is left to the
+ * caller. 'write_nibble' sends the upper half of a command alone, for
+ * the reset sequence; it is NULL when the controller is set up by
+ * someone else (e.g. the kernel driver). 'sync', when not NULL, waits
+ * until the display has executed every byte written so far.
+ */
+
+#define LCD_TRANSPORT_PACED   0x1  /* the other end waits for the execution
+                                      times itself; 'sync' waits for it */
+#define LCD_TRANSPORT_NOSHIFT 0x2  /* no display shift: the other end keeps
+                                      its own model of the screen */
+
+struct lcd_transport {
+  const char *name;
+  int bus;
+  unsigned int flags;
+  size_t burst;
+  unsigned long transactions;   /* system calls or bus transactions so far */
+  int  ( *write ) ( struct lcd_transport *t, int display, int rs,
+                    const unsigned char *buf, size_t len );
+  int  ( *write_nibble ) ( struct lcd_transport *t, int display,
+                           unsigned char nibble );
+  int  ( *sync ) ( struct lcd_transport *t, int display );
+  void ( *close ) ( struct lcd_transport *t );
+};
+
+/*
+ * Pin map of a parallel bus: RS and the data lines are shared by all
+ * displays, each display has its own EN line. data[i] drives bit 'i'
+ * of the bus (DB4-DB7 on a 4-bit bus, DB0-DB7 on an 8-bit one).
+ * All pins must be in the first GPIO bank (0 to 31).
+ */
+
+struct lcd_pins {
+  int bus;
+  int rs;
+  int data[8];
+  int en[LCD_MAX_DISPLAYS];
+  int n;
+};
+
+/*
+ * Fill 'pins' with the wiring of the lab board for a bus of 'bus' bits
+ * and a single display.
+ */
+
+void
+lcd_pins_default ( struct lcd_pins *pins, int bus );
+
+/*
+ * Open a transport. Return NULL in case of error.
+ *
+ * lcd_gpio_open     - the GPIO controller mapped by libgpio.
+ * lcd_gpiochip_open - lines of the GPIO character device 'dev'
+ *                     (/dev/gpiochipN), one ioctl per bus edge; no root
+ *                     needed. Works with the gpio-sim or gpio-mockup
+ *                     modules as well.
+ * lcd_chrdev_open   - the bcm2708_lcd driver, one device file per display.
+ * lcd_sim_open      - simulated GPIO bank and HD44780 controllers.
+ * lcd_i2c_open      - PCF8574 I2C expanders on adapter 'dev' (/dev/i2c-N),
+ *                     display 'i' at address addr[i]. At most 'batch'
+ *                     expander bytes per transaction (0: a whole write).
+ * lcd_i2c_sim_open  - the same, with simulated expanders and controllers.
+ */
+
+struct lcd_transport *
+lcd_gpio_open ( const struct lcd_pins *pins );
+
+struct lcd_transport *
+lcd_gpiochip_open ( const struct lcd_pins *pins, const char *dev );
+
+struct lcd_transport *
+lcd_chrdev_open ( const char * const *paths, int n );
+
+struct lcd_transport *
+lcd_sim_open ( const struct lcd_pins *pins );
+
+struct lcd_transport *
+lcd_i2c_open ( const char *dev, const int *addr, int n, size_t batch );
+
+struct lcd_transport *
+lcd_i2c_sim_open ( int n, size_t batch );
+
+/*
+ * Close a transport opened by one of the functions above.
+ */
+
+void
+lcd_transport_close ( struct lcd_transport *t );
+
+
+/* Pending operation on a display. */
+struct lcd_op {
+  unsigned char rs;
+  unsigned char nibble_only;
+  unsigned char value;
+  unsigned short wait;
+};
+
+/*
+ * State of one display. Execution times are not waited for after each
+ * command: 'ready' records when the display accepts new bytes, and
+ * lcd_schedule() uses the shared bus for other displays meanwhile.
+ *
+ * The queued commands and data also update a shadow of the controller
+ * (DDRAM contents, address counter, entry mode, display shift), which
+ * lcd_update() compares with and lcd_detach() saves.
+ */
+
+struct lcd {
+  struct lcd_transport *t;
+  int display;
+  unsigned long long ready;
+  struct lcd_op queue[LCD_QUEUE];
+  int head, count;
+  unsigned long sent;   /* bytes (or single nibbles) sent so far */
+  unsigned char ddram[2 * LCD_DDRAM_LINE];  /* line 0, then line 1 */
+  unsigned char ac;     /* index in 'ddram', 0xff: in the CGRAM */
+  unsigned char entry;  /* last "Entry mode set" */
+  int shift;            /* display shift, in cells */
+  char state[64];       /* state file of lcd_attach(), "" if none */
+};
+
+/*
+ * Bind 'lcd' to display number 'display' of the transport and queue
+ * its reset sequence (configuration and clear).
+ */
+
+void
+lcd_open ( struct lcd *lcd, struct lcd_transport *t, int display );
+
+/*
+ * Clear the display and wait until it is idle.
+ */
+
+void
+lcd_close ( struct lcd *lcd );
+
+/*
+ * Warm attach: like lcd_open(), but if the state file 'path' (NULL:
+ * LCD_STATE_DIR/lcd-<transport>-<display>.state) was left by
+ * lcd_detach() for the same bus width, take the configuration and the
+ * contents of the display from it instead of resetting and clearing
+ * the controller. The file is removed until lcd_detach(), so that a
+ * program that dies meanwhile leaves no stale state behind.
+ * Return 1 for a warm attach, 0 if the reset sequence was queued.
+ */
+
+int
+lcd_attach ( struct lcd *lcd, struct lcd_transport *t, int display,
+             const char *path );
+
+/*
+ * Wait until the display is idle and save its state for the next
+ * lcd_attach(), leaving the screen as it is.
+ * Return -1 in case of error, 0 otherwise.
+ */
+
+int
+lcd_detach ( struct lcd *lcd );
+
+/*
+ * Queue operations. Nothing is sent before lcd_schedule() or lcd_sync().
+ */
+
+void
+lcd_queue_cmd ( struct lcd *lcd, unsigned char cmd, unsigned int wait );
+
+void
+lcd_queue_data ( struct lcd *lcd, unsigned char c );
+
+void
+lcd_queue_string ( struct lcd *lcd, const char *s, size_t len );
+
+void
+lcd_set_ddram ( struct lcd *lcd, unsigned char addr );
+
+void
+lcd_set_position ( struct lcd *lcd, int row, int col );
+
+void
+lcd_clear ( struct lcd *lcd );
+
+void
+lcd_home ( struct lcd *lcd );
+
+void
+lcd_config_clear ( struct lcd *lcd );
+
+/*
+ * Show the 'len' characters of 's' from row 'row', column 'col', but
+ * queue only the cells that differ from the shadow, with one DDRAM
+ * address command per run of changed cells.
+ */
+
+void
+lcd_update ( struct lcd *lcd, int row, int col, const char *s, size_t len );
+
+/*
+ * Send the queues of the 'n' displays of 'lcd' (which share one
+ * transport), interleaving them: the display that is ready first is
+ * always served first.
+ */
+
+void
+lcd_schedule ( struct lcd *lcd, int n );
+
+/*
+ * Send the queue of 'lcd' and wait until the display is idle.
+ */
+
+void
+lcd_sync ( struct lcd *lcd );
+
+/*
+ * Time helpers used by the protocol and by the transports.
+ */
+
+unsigned long long
+lcd_now_us ( void );
+
+void
+lcd_udelay ( unsigned int us );
+
+/*
+ * Virtual clock: when 'on', lcd_udelay() advances a simulated date
+ * returned by lcd_now_us() instead of sleeping, so that protocol runs
+ * on the simulated transports take only their CPU time, and their
+ * timing is still checked against the simulated date. Only for the
+ * simulated transports: real controllers would miss every delay.
+ */
+
+void
+lcd_clock_virtual ( int on );
+
+
+/*
+ * Marquee: a text scrolled on one DDRAM line by display shifts.
+ *
+ * The whole 40-cell line is loaded once, then each step sends a single
+ * "Cursor/display shift" command. Cells leaving the screen on the left
+ * are rewritten in one batch while they are off-screen. The shift
+ * applies to both DDRAM lines (and rows 2 and 3 of a 4x20 display show
+ * the second half of lines 0 and 1). Not for the transports flagged
+ * LCD_TRANSPORT_NOSHIFT.
+ */
+
+struct lcd_marquee {
+  struct lcd *lcd;
+  const char *text;
+  size_t len;
+  int line;
+  unsigned long step;
+  int pending;
+};
+
+void
+lcd_marquee_init ( struct lcd_marquee *m, struct lcd *lcd, int line,
+                   const char *text, size_t len );
+
+/*
+ * Shift the text one cell to the left (queued, see lcd_schedule()).
+ * Costs one command byte, plus a 20-cell batch every 20 steps.
+ */
+
+void
+lcd_marquee_step ( struct lcd_marquee *m );
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * RpiLab: lab2
+ *
+ * liblcd benchmark: throughput and latency of the same workloads on
+ * every transport.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "lcd.h"
+#include "lcd_sim.h"
+
+
+// Charges mesurées
+#define TEST_FRAME   0   // écran complet : 4 lignes de 20 caractères
+#define TEST_UPDATE  1   // mise à jour d'un champ de 6 caractères
+#define TEST_CLEAR   2   // "Clear display"
+#define TEST_MARQUEE 3   // un pas de défilement
+#define TEST_NR      4
+
+static const char *test_name[] = {"frame", "update", "clear", "marquee"};
+
+
+static char frame[LCD_ROWS][LCD_COLS + 1];
+static const char marquee_text[] =
+  "liblcd benchmark: one display shift per step -- ";
+
+
+
+// Temps CPU du processus en microsecondes
+static unsigned long long cpu_us(void){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+static int compare(const void *a, const void *b){
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+
+
+// Une opération de la charge "test", numéro "i"
+static void run_op(struct lcd *lcd, struct lcd_marquee *m, int test, int i){
+  int row;
+
+  switch(test){
+  case TEST_FRAME:
+    for(row=0;row<LCD_ROWS;row++){
+      snprintf(frame[row], sizeof(frame[row]), "row %d frame %-8d", row, i % 100000000);
+      lcd_set_position(lcd, row, 0);
+      lcd_queue_string(lcd, frame[row], LCD_COLS);
+    }
+    break;
+  case TEST_UPDATE:
+    snprintf(frame[1] + 5, sizeof(frame[1]) - 5, "%6d", i % 1000000);
+    frame[1][11] = ' ';
+    lcd_set_position(lcd, 1, 5);
+    lcd_queue_string(lcd, frame[1] + 5, 6);
+    break;
+  case TEST_CLEAR:
+    lcd_clear(lcd);
+    memset(frame, ' ', sizeof(frame));
+    for(row=0;row<LCD_ROWS;row++)
+      frame[row][LCD_COLS] = '\0';
+    break;
+  case TEST_MARQUEE:
+    lcd_marquee_step(m);
+    break;
+  }
+}
+
+
+
+// Exécute "n" fois une charge, et affiche débit et latences
+static void run_test(struct lcd *lcd, int test, int n){
+  unsigned long long *lat, t0, t1, start, cpu, total, sum;
+  unsigned long sent, tx;
+  struct lcd_marquee m;
+  int i;
+
+  lat = malloc(n * sizeof(*lat));
+  if(lat == NULL)
+    return;
+
+  if(test == TEST_MARQUEE){
+    lcd_marquee_init(&m, lcd, 0, marquee_text, strlen(marquee_text));
+    lcd_sync(lcd);
+  }
+
+  sent = lcd->sent;
+  tx = lcd->t->transactions;
+  cpu = cpu_us();
+  start = lcd_now_us();
+
+  for(i=0;i<n;i++){
+    t0 = lcd_now_us();
+    run_op(lcd, &m, test, i);
+    lcd_sync(lcd);
+    t1 = lcd_now_us();
+    lat[i] = t1 - t0;
+  }
+
+  total = lcd_now_us() - start;
+  cpu = cpu_us() - cpu;
+  sent = lcd->sent - sent;
+  tx = lcd->t->transactions - tx;
+
+  qsort(lat, n, sizeof(*lat), compare);
+  for(sum=0,i=0;i<n;i++)
+    sum += lat[i];
+
+  printf("%-8s %6d %10.1f %9.1f %9.1f %7.1f %7.1f %7llu %7llu %7llu %7llu %7llu %9.1f\n",
+         test_name[test], n, total / 1000.0,
+         n * 1e6 / total, sent * 1e6 / total, (double)sent / n,
+         (double)tx / n,
+         lat[0], sum / n, lat[n / 2], lat[n * 99 / 100], lat[n - 1],
+         cpu / 1000.0);
+
+  free(lat);
+}
+
+
+
+// Vérifie que l'écran simulé affiche la dernière image envoyée
+static void check_sim(struct lcd_sim *sim){
+  struct lcd_sim_display *d = &sim->disp[0];
+  char row[LCD_COLS + 1];
+  int ok = 1;
+  int i;
+
+  for(i=0;i<LCD_ROWS;i++){
+    lcd_sim_row(d, i, row);
+    printf("  |%s|\n", row);
+    if(strcmp(row, frame[i]) != 0)
+      ok = 0;
+  }
+
+  printf("sim: %lu strobes, %lu commands, %lu data, %lu timing violations, "
+         "screen %s\n", d->strobes, d->cmds, d->data, d->violations,
+         ok ? "ok" : "KO");
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr,
+          "usage: %s [-t gpio|gpio8|gpiochip|gpiochip8|chrdev|sim|sim8|i2c|i2c-sim] [-d device]\n"
+          "          [-a i2c address] [-b i2c bytes per transaction] [-n count] [-v]\n"
+          "  -v: virtual clock (sim and i2c-sim only), times are simulated bus time\n",
+          name);
+  exit(1);
+}
+
+
+
+// Fonction principale
+int main ( int argc, char *argv[] )
+{
+  const char *type = "sim";
+  const char *dev = NULL;
+  struct lcd_transport *t;
+  struct lcd_pins pins;
+  struct lcd lcd;
+  int addr = 0x27;
+  size_t batch = 0;
+  int n = 100;
+  int virtual = 0;
+  int opt, i;
+
+  while((opt = getopt(argc, argv, "t:d:a:b:n:v")) != -1){
+    switch(opt){
+    case 't': type = optarg; break;
+    case 'd': dev = optarg; break;
+    case 'a': addr = strtol(optarg, NULL, 0); break;
+    case 'b': batch = atoi(optarg); break;
+    case 'n': n = atoi(optarg); break;
+    case 'v': virtual = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  if(n < 1)
+    usage(argv[0]);
+
+  // Horloge virtuelle : seuls les contrôleurs simulés la suivent
+  if(virtual && strncmp(type, "sim", 3) != 0 && strcmp(type, "i2c-sim") != 0)
+    usage(argv[0]);
+  lcd_clock_virtual(virtual);
+
+  lcd_pins_default(&pins, strchr(type, '8') ? LCD_BUS_8BIT : LCD_BUS_4BIT);
+
+  if(strncmp(type, "gpiochip", 8) == 0)
+    t = lcd_gpiochip_open(&pins, dev != NULL ? dev : "/dev/gpiochip0");
+  else if(strncmp(type, "gpio", 4) == 0)
+    t = lcd_gpio_open(&pins);
+  else if(strncmp(type, "sim", 3) == 0)
+    t = lcd_sim_open(&pins);
+  else if(strcmp(type, "chrdev") == 0){
+    if(dev == NULL)
+      dev = "/dev/bcm2708_lcd";
+    t = lcd_chrdev_open(&dev, 1);
+  }
+  else if(strcmp(type, "i2c") == 0)
+    t = lcd_i2c_open(dev != NULL ? dev : "/dev/i2c-1", &addr, 1, batch);
+  else if(strcmp(type, "i2c-sim") == 0)
+    t = lcd_i2c_sim_open(1, batch);
+  else
+    usage(argv[0]);
+
+  if(t == NULL){
+    fprintf(stderr, "%s: cannot open transport %s\n", argv[0], type);
+    return 1;
+  }
+
+  lcd_open(&lcd, t, 0);
+  lcd_sync(&lcd);
+
+  printf("transport %s, %d-bit bus, %d operations per test, %s clock\n",
+         t->name, t->bus, n, virtual ? "virtual (simulated bus time)" : "real");
+  printf("%-8s %6s %10s %9s %9s %7s %7s %7s %7s %7s %7s %7s %9s\n",
+         "test", "ops", "total(ms)", "ops/s", "bytes/s", "B/op", "tx/op",
+         "min", "avg", "p50", "p99", "max(us)", "cpu(ms)");
+
+  for(i=0;i<TEST_NR;i++){
+    // L'image de référence est toujours la dernière écrite
+    if(i == TEST_MARQUEE)
+      continue;
+    run_test(&lcd, i, n);
+    if(i == TEST_CLEAR)
+      run_test(&lcd, TEST_FRAME, 1);
+  }
+
+  if(strncmp(type, "sim", 3) == 0)
+    check_sim(lcd_sim_get(t));
+  else if(strcmp(type, "i2c-sim") == 0)
+    check_sim(lcd_i2c_sim_get(t, 0));
+
+  // Le pilote noyau ne suit pas le décalage de l'affichage
+  if(t->flags & LCD_TRANSPORT_NOSHIFT)
+    printf("%-8s skipped: no display shift on transport %s\n",
+           test_name[TEST_MARQUEE], t->name);
+  else
+    run_test(&lcd, TEST_MARQUEE, n);
+
+  lcd_close(&lcd);
+  lcd_transport_close(t);
+
+  return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * liblcd: bus parallèle HD44780 (RS, D0-D3 ou D0-D7, un EN par afficheur).
+ */
+
+#include <string.h>
+
+#include "lcd_bus.h"
+
+
+// Câblage de la carte du TME : RS, DB4-DB7, puis DB0-DB3 en mode 8 bits
+#define GPIO_EN 23
+#define GPIO_RS 18
+#define GPIO_D0 4
+#define GPIO_D1 17
+#define GPIO_D2 27
+#define GPIO_D3 22
+
+#define GPIO_DB0 24
+#define GPIO_DB1 25
+#define GPIO_DB2 8
+#define GPIO_DB3 7
+
+
+// Durée de l'impulsion sur EN (us)
+#define LCD_EN_PULSE 50
+
+
+
+// Câblage par défaut, pour un bus de "bus" bits et un seul afficheur
+void lcd_pins_default(struct lcd_pins *pins, int bus){
+  static const int data4[] = {GPIO_D0,GPIO_D1,GPIO_D2,GPIO_D3};
+  static const int data8[] = {GPIO_DB0,GPIO_DB1,GPIO_DB2,GPIO_DB3,
+                              GPIO_D0,GPIO_D1,GPIO_D2,GPIO_D3};
+
+  memset(pins, 0, sizeof(*pins));
+  pins->bus = bus;
+  pins->rs = GPIO_RS;
+  memcpy(pins->data, bus == LCD_BUS_8BIT ? data8 : data4,
+         bus * sizeof(int));
+  pins->en[0] = GPIO_EN;
+  pins->n = 1;
+}
+
+
+
+// Permet de créer un front descendant sur le GPIO EN de l'afficheur
+static void lcd_bus_strobe(struct lcd_bus *b, int display){
+  unsigned int en = 1u << b->pins.en[display];
+
+  b->update_mask(b->ctx, en, 0);
+  lcd_udelay(LCD_EN_PULSE);
+  b->update_mask(b->ctx, 0, en);
+}
+
+
+
+// Envoie 4 ou 8 bits, puis réalise un front descendant pour prendre en
+// compte les signaux envoyés. RS et les données changent ensemble :
+// une écriture dans GPSET0 et une dans GPCLR0.
+static void lcd_bus_cycle(struct lcd_bus *b, int display, int rs,
+                          unsigned char value){
+  unsigned int rs_mask = 1u << b->pins.rs;
+
+  b->update_mask(b->ctx, b->set[value] | (rs ? rs_mask : 0),
+                 b->clr[value] | (rs ? 0 : rs_mask));
+  lcd_bus_strobe(b, display);
+}
+
+
+
+// Envoie "len" octets avec le même RS
+static int lcd_bus_write(struct lcd_transport *t, int display, int rs,
+                         const unsigned char *buf, size_t len){
+  struct lcd_bus *b = (struct lcd_bus *)t;
+  size_t i;
+
+  for(i=0;i<len;i++){
+    if(i > 0)
+      lcd_udelay(LCD_WAIT_CMD);
+
+    if(b->pins.bus == LCD_BUS_8BIT){
+      lcd_bus_cycle(b, display, rs, buf[i]);
+    }
+    else{
+      // On envoie les bits de poids forts puis les bits de poids faibles
+      lcd_bus_cycle(b, display, rs, buf[i] >> 4);
+      lcd_bus_cycle(b, display, rs, buf[i] & 0xf);
+    }
+  }
+
+  return 0;
+}
+
+
+
+// Envoie la moitié haute d'une commande seule (séquence d'initialisation) :
+// en mode 8 bits, elle arrive sur DB4-DB7
+static int lcd_bus_write_nibble(struct lcd_transport *t, int display,
+                                unsigned char nibble){
+  struct lcd_bus *b = (struct lcd_bus *)t;
+
+  if(b->pins.bus == LCD_BUS_8BIT)
+    nibble <<= 4;
+
+  lcd_bus_cycle(b, display, RS_CMD, nibble);
+  return 0;
+}
+
+
+
+// Masque de toutes les broches du bus
+unsigned int lcd_bus_mask(const struct lcd_bus *b){
+  unsigned int mask = 1u << b->pins.rs;
+  int i;
+
+  for(i=0;i<b->pins.bus;i++)
+    mask |= 1u << b->pins.data[i];
+  for(i=0;i<b->pins.n;i++)
+    mask |= 1u << b->pins.en[i];
+
+  return mask;
+}
+
+
+
+// Calcule les masques GPSET0/GPCLR0 de chaque valeur du bus
+int lcd_bus_init(struct lcd_bus *b, const struct lcd_pins *pins){
+  int v, i;
+
+  if((pins->bus != LCD_BUS_4BIT && pins->bus != LCD_BUS_8BIT) ||
+     pins->n < 1 || pins->n > LCD_MAX_DISPLAYS)
+    return -1;
+
+  if(pins->rs < 0 || pins->rs > 31)
+    return -1;
+  for(i=0;i<pins->bus;i++){
+    if(pins->data[i] < 0 || pins->data[i] > 31)
+      return -1;
+  }
+  for(i=0;i<pins->n;i++){
+    if(pins->en[i] < 0 || pins->en[i] > 31)
+      return -1;
+  }
+
+  b->pins = *pins;
+
+  for(v=0;v<(1<<pins->bus);v++){
+    b->set[v] = b->clr[v] = 0;
+    for(i=0;i<pins->bus;i++){
+      if(v & (1<<i))
+        b->set[v] |= 1u << pins->data[i];
+      else
+        b->clr[v] |= 1u << pins->data[i];
+    }
+  }
+
+  b->t.bus = pins->bus;
+  b->t.flags = 0;
+  b->t.burst = LCD_QUEUE;
+  b->t.write = lcd_bus_write;
+  b->t.write_nibble = lcd_bus_write_nibble;
+  b->t.sync = NULL;
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef _LCD_BUS_H_
+#define _LCD_BUS_H_
+
+#include "lcd.h"
+
+/*
+ * Parallel HD44780 bus, shared by the GPIO and the simulated transports.
+ *
+ * The pins are driven through 'update_mask', which sets the pins of
+ * 'set' and clears those of 'clear' at once (GPSET0/GPCLR0 semantics).
+ */
+
+struct lcd_bus {
+  struct lcd_transport t;
+  struct lcd_pins pins;
+  unsigned int set[256], clr[256];
+  int  ( *update_mask ) ( void *ctx, unsigned int set, unsigned int clear );
+  void *ctx;
+};
+
+/*
+ * Set up the transport operations and the pin masks of 'b' for 'pins'.
+ * Return -1 if a pin is outside the first bank, 0 otherwise.
+ */
+
+int
+lcd_bus_init ( struct lcd_bus *b, const struct lcd_pins *pins );
+
+/*
+ * Mask of every pin of the bus.
+ */
+
+unsigned int
+lcd_bus_mask ( const struct lcd_bus *b );
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * liblcd: transport par le pilote noyau bcm2708_lcd (/dev/bcm2708_lcd).
+ *
+ * Le pilote initialise lui-même le contrôleur. write() ne fait que mettre
+ * le texte en file pour sa tâche de mise à jour ; une commande attend la
+ * fin des write() précédents, et fsync() celle de tout ce qui est en file.
+ * Le pilote gère son curseur en coordonnées d'écran : les données
+ * passent d'une ligne de l'écran à la suivante, et non d'une ligne de la
+ * DDRAM à la suivante comme sur le contrôleur. Un décalage de
+ * l'affichage fausserait ce modèle, et celui des autres fichiers ouverts :
+ * le transport refuse ces commandes.
+ */
+
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <bcm2708_lcd.h>
+
+#include "lcd.h"
+
+
+struct lcd_chrdev {
+  struct lcd_transport t;
+  int fd[LCD_MAX_DISPLAYS];
+  int n;
+};
+
+
+
+// Les données passent par un seul write(), chaque commande par un ioctl
+static int lcd_chrdev_write(struct lcd_transport *t, int display, int rs,
+                            const unsigned char *buf, size_t len){
+  struct lcd_chrdev *c = (struct lcd_chrdev *)t;
+  size_t i;
+
+  if(rs == RS_DATA){
+    t->transactions++;
+    return write(c->fd[display], buf, len) == (ssize_t)len ? 0 : -1;
+  }
+
+  for(i=0;i<len;i++){
+    // Décalage de l'affichage : hors du modèle du pilote
+    if(((buf[i] & 0xf0) == CMD_CDSHIFT && (buf[i] & CMD_CDSHIFT_SC)) ||
+       ((buf[i] & 0xfc) == CMD_ENTRY && (buf[i] & CMD_ENTRY_S)))
+      return -1;
+
+    t->transactions++;
+    if(ioctl(c->fd[display], BCM2708_LCD_IOCCMD, buf[i]) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+
+
+// Attend que le pilote ait envoyé à l'afficheur tout ce qui est en file
+static int lcd_chrdev_sync(struct lcd_transport *t, int display){
+  struct lcd_chrdev *c = (struct lcd_chrdev *)t;
+
+  t->transactions++;
+  return fsync(c->fd[display]);
+}
+
+
+
+static void lcd_chrdev_close(struct lcd_transport *t){
+  struct lcd_chrdev *c = (struct lcd_chrdev *)t;
+  int i;
+
+  for(i=0;i<c->n;i++)
+    close(c->fd[i]);
+  free(c);
+}
+
+
+
+// Ouverture d'un fichier spécial par afficheur
+struct lcd_transport *lcd_chrdev_open(const char * const *paths, int n){
+  struct lcd_chrdev *c;
+
+  if(n < 1 || n > LCD_MAX_DISPLAYS)
+    return NULL;
+
+  c = calloc(1, sizeof(*c));
+  if(c == NULL)
+    return NULL;
+
+  for(c->n=0;c->n<n;c->n++){
+    c->fd[c->n] = open(paths[c->n], O_WRONLY);
+    if(c->fd[c->n] < 0){
+      lcd_chrdev_close(&c->t);
+      return NULL;
+    }
+  }
+
+  c->t.name = "chrdev";
+  c->t.bus = 0;
+  c->t.flags = LCD_TRANSPORT_PACED | LCD_TRANSPORT_NOSHIFT;
+  c->t.burst = LCD_QUEUE;
+  c->t.write = lcd_chrdev_write;
+  c->t.write_nibble = NULL;
+  c->t.sync = lcd_chrdev_sync;
+  c->t.close = lcd_chrdev_close;
+
+  return &c->t;
+}
@@ -0,0 +1,71 @@
+/*
+ * liblcd: transport par accès direct au contrôleur GPIO (libgpio).
+ */
+
+#include <stdlib.h>
+
+#include <gpio.h>
+
+#include "lcd_bus.h"
+
+
+
+static int lcd_gpio_update_mask(void *ctx, unsigned int set,
+                                unsigned int clear){
+  return gpio_update_mask(set, clear);
+}
+
+
+
+// Remet toutes les broches du bus à 0 et en entrée
+static void lcd_gpio_close(struct lcd_transport *t){
+  struct lcd_bus *b = (struct lcd_bus *)t;
+  unsigned int mask = lcd_bus_mask(b);
+  int i;
+
+  gpio_update_mask(0, mask);
+
+  for(i=0;i<32;i++){
+    if(mask & (1u << i))
+      gpio_config(i, GPIO_INPUT_PIN);
+  }
+
+  gpio_teardown();
+  free(b);
+}
+
+
+
+// Ouverture du transport : projection du contrôleur GPIO et
+// configuration de toutes les broches du bus en sortie
+struct lcd_transport *lcd_gpio_open(const struct lcd_pins *pins){
+  struct lcd_bus *b;
+  unsigned int mask;
+  int i;
+
+  b = calloc(1, sizeof(*b));
+  if(b == NULL)
+    return NULL;
+
+  if(lcd_bus_init(b, pins) == -1 || gpio_setup() == -1){
+    free(b);
+    return NULL;
+  }
+
+  b->t.name = "gpio";
+  b->t.close = lcd_gpio_close;
+  b->update_mask = lcd_gpio_update_mask;
+
+  mask = lcd_bus_mask(b);
+  for(i=0;i<32;i++){
+    if((mask & (1u << i)) && gpio_config(i, GPIO_OUTPUT_PIN) == -1){
+      gpio_teardown();
+      free(b);
+      return NULL;
+    }
+  }
+
+  gpio_update_mask(0, mask);
+
+  return &b->t;
+}
@@ -0,0 +1,70 @@
+/*
+ * liblcd: transport par les lignes d'un /dev/gpiochipN (libgpio), sans
+ * /dev/mem : toutes les broches du bus sont prises en une seule requête,
+ * chaque front est un seul ioctl.
+ */
+
+#include <stdlib.h>
+
+#include <gpio.h>
+
+#include "lcd_bus.h"
+
+
+struct lcd_gpiochip {
+  struct lcd_bus b;
+  struct gpio_chip *chip;
+};
+
+
+
+static int lcd_gpiochip_update_mask(void *ctx, unsigned int set,
+                                    unsigned int clear){
+  struct lcd_gpiochip *g = ctx;
+
+  g->b.t.transactions++;
+  return gpio_chip_update_mask(g->chip, set, clear);
+}
+
+
+
+// Remet toutes les broches du bus à 0 ; en rendant les lignes, le
+// noyau les laisse en l'état
+static void lcd_gpiochip_close(struct lcd_transport *t){
+  struct lcd_gpiochip *g = (struct lcd_gpiochip *)t;
+
+  gpio_chip_update_mask(g->chip, 0, lcd_bus_mask(&g->b));
+  gpio_chip_close(g->chip);
+  free(g);
+}
+
+
+
+// Ouverture du transport : une requête de lignes sur 'dev' pour toutes
+// les broches du bus, en sortie et à 0
+struct lcd_transport *lcd_gpiochip_open(const struct lcd_pins *pins,
+                                        const char *dev){
+  struct lcd_gpiochip *g;
+
+  g = calloc(1, sizeof(*g));
+  if(g == NULL)
+    return NULL;
+
+  if(lcd_bus_init(&g->b, pins) == -1){
+    free(g);
+    return NULL;
+  }
+
+  g->chip = gpio_chip_open(dev, lcd_bus_mask(&g->b), 0, 0);
+  if(g->chip == NULL){
+    free(g);
+    return NULL;
+  }
+
+  g->b.t.name = "gpiochip";
+  g->b.t.close = lcd_gpiochip_close;
+  g->b.update_mask = lcd_gpiochip_update_mask;
+  g->b.ctx = g;
+
+  return &g->b.t;
+}
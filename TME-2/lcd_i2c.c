@@ -0,0 +1,323 @@
+/*
+ * liblcd: transport I2C, afficheurs derrière un expandeur PCF8574
+ * (/dev/i2c-N).
+ *
+ * Chaque écriture de l'expandeur fixe ses 8 sorties : RS, RW, EN, le
+ * rétroéclairage et DB4-DB7. Un quartet demande donc deux octets (EN à 1
+ * puis à 0). Tous les octets d'un appel sont regroupés dans une seule
+ * transaction I2C au lieu d'une transaction par changement de broche.
+ *
+ * À 100 kHz, un octet de l'expandeur dure 90 us : le temps d'exécution
+ * d'une commande ordinaire est déjà écoulé entre deux octets du HD44780.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "lcd.h"
+#include "lcd_sim.h"
+
+
+// Sorties du PCF8574 (câblage des modules "LCM1602")
+#define PCF_RS 0x01
+#define PCF_RW 0x02
+#define PCF_EN 0x04
+#define PCF_BL 0x08
+
+// Durée d'un octet sur le bus à 100 kHz (us), pour le banc simulé
+#define I2C_BYTE_US 90
+
+// Modes de transfert, selon ce que permet l'adaptateur
+#define I2C_MODE_RDWR  0   // I2C_RDWR : un message de taille quelconque
+#define I2C_MODE_BLOCK 1   // SMBus "I2C block write" : 1 + 32 octets
+#define I2C_MODE_BYTE  2   // SMBus "write byte" : un octet
+#define I2C_MODE_SIM   3   // banc simulé, en espace utilisateur
+
+#define I2C_BUF 1024
+
+
+struct lcd_i2c {
+  struct lcd_transport t;
+  int mode;
+  int fd;
+  int addr[LCD_MAX_DISPLAYS];
+  int slave;                          // adresse choisie par I2C_SLAVE
+  struct lcd_sim *sim[LCD_MAX_DISPLAYS];
+  int n;
+  size_t batch;                       // octets par transaction (0 : tous)
+  unsigned char buf[I2C_BUF];
+  size_t len;
+  unsigned char last[LCD_MAX_DISPLAYS]; // dernier octet écrit sur chaque expandeur
+  unsigned int written;               // expandeurs déjà écrits (bit "display")
+};
+
+
+
+// Envoie "len" octets à l'expandeur en une transaction
+static int lcd_i2c_xfer(struct lcd_i2c *c, int display,
+                        const unsigned char *buf, size_t len){
+  struct i2c_rdwr_ioctl_data rdwr;
+  union i2c_smbus_data data;
+  struct i2c_smbus_ioctl_data smbus;
+  struct i2c_msg msg;
+  size_t i;
+
+  c->t.transactions++;
+
+  if(c->mode == I2C_MODE_SIM){
+    lcd_udelay(I2C_BYTE_US);
+    for(i=0;i<len;i++){
+      lcd_udelay(I2C_BYTE_US);
+      lcd_sim_update_mask(c->sim[display], buf[i], ~buf[i] & 0xff);
+    }
+    return 0;
+  }
+
+  if(c->mode == I2C_MODE_RDWR){
+    msg.addr = c->addr[display];
+    msg.flags = 0;
+    msg.len = len;
+    msg.buf = (unsigned char *)buf;
+    rdwr.msgs = &msg;
+    rdwr.nmsgs = 1;
+    return ioctl(c->fd, I2C_RDWR, &rdwr) < 0 ? -1 : 0;
+  }
+
+  // Les transferts SMBus s'adressent à l'esclave choisi par I2C_SLAVE
+  if(c->slave != c->addr[display]){
+    if(ioctl(c->fd, I2C_SLAVE, c->addr[display]) < 0)
+      return -1;
+    c->slave = c->addr[display];
+  }
+
+  // Le PCF8574 n'a pas de registre : l'octet de "commande" d'un
+  // transfert SMBus est une écriture de ses sorties comme les autres
+  smbus.read_write = I2C_SMBUS_WRITE;
+  smbus.command = buf[0];
+  smbus.data = &data;
+  if(c->mode == I2C_MODE_BLOCK && len > 1){
+    data.block[0] = len - 1;
+    memcpy(&data.block[1], buf + 1, len - 1);
+    smbus.size = I2C_SMBUS_I2C_BLOCK_DATA;
+  }
+  else{
+    smbus.size = I2C_SMBUS_BYTE;
+    smbus.data = NULL;
+  }
+
+  return ioctl(c->fd, I2C_SMBUS, &smbus) < 0 ? -1 : 0;
+}
+
+
+
+// Vide le tampon, en autant de transactions que le mode l'impose
+static int lcd_i2c_flush(struct lcd_i2c *c, int display){
+  size_t max, done, n;
+
+  switch(c->mode){
+  case I2C_MODE_BLOCK: max = 1 + I2C_SMBUS_BLOCK_MAX; break;
+  case I2C_MODE_BYTE:  max = 1; break;
+  default:             max = c->len; break;
+  }
+  if(c->batch > 0 && c->batch < max)
+    max = c->batch;
+
+  for(done=0;done<c->len;done+=n){
+    n = c->len - done < max ? c->len - done : max;
+    if(lcd_i2c_xfer(c, display, c->buf + done, n) == -1){
+      c->len = 0;
+      return -1;
+    }
+  }
+
+  c->len = 0;
+  return 0;
+}
+
+
+
+// Ajoute un octet de l'expandeur au tampon
+static int lcd_i2c_put(struct lcd_i2c *c, int display, unsigned char v){
+  if(c->len == I2C_BUF && lcd_i2c_flush(c, display) == -1)
+    return -1;
+
+  c->buf[c->len++] = v;
+  c->last[display] = v;
+  c->written |= 1U << display;
+  return 0;
+}
+
+
+
+// Un quartet : données et EN à 1, puis EN à 0. Si RS change, il est
+// d'abord positionné seul, EN à 0, pour respecter son temps d'établissement.
+// Chaque afficheur a son expandeur : on compare au dernier octet du sien, et
+// le premier octet envoyé à un expandeur fixe toujours RS seul.
+static int lcd_i2c_nibble(struct lcd_i2c *c, int display, int rs,
+                          unsigned char nibble){
+  unsigned char v = (nibble << 4) | PCF_BL | (rs ? PCF_RS : 0);
+
+  if((!(c->written & 1U << display) || (c->last[display] & PCF_RS) != (v & PCF_RS)) &&
+     lcd_i2c_put(c, display, v) == -1)
+    return -1;
+
+  if(lcd_i2c_put(c, display, v | PCF_EN) == -1 ||
+     lcd_i2c_put(c, display, v) == -1)
+    return -1;
+
+  return 0;
+}
+
+
+
+static int lcd_i2c_write(struct lcd_transport *t, int display, int rs,
+                         const unsigned char *buf, size_t len){
+  struct lcd_i2c *c = (struct lcd_i2c *)t;
+  size_t i;
+
+  for(i=0;i<len;i++){
+    if(lcd_i2c_nibble(c, display, rs, buf[i] >> 4) == -1 ||
+       lcd_i2c_nibble(c, display, rs, buf[i] & 0xf) == -1)
+      return -1;
+  }
+
+  return lcd_i2c_flush(c, display);
+}
+
+
+
+static int lcd_i2c_write_nibble(struct lcd_transport *t, int display,
+                                unsigned char nibble){
+  struct lcd_i2c *c = (struct lcd_i2c *)t;
+
+  if(lcd_i2c_nibble(c, display, RS_CMD, nibble) == -1)
+    return -1;
+
+  return lcd_i2c_flush(c, display);
+}
+
+
+
+static void lcd_i2c_close(struct lcd_transport *t){
+  struct lcd_i2c *c = (struct lcd_i2c *)t;
+  int i;
+
+  if(c->fd >= 0)
+    close(c->fd);
+  for(i=0;i<c->n;i++)
+    lcd_sim_destroy(c->sim[i]);
+  free(c);
+}
+
+
+
+// Partie commune aux deux ouvertures
+static struct lcd_i2c *lcd_i2c_alloc(int n, size_t batch){
+  struct lcd_i2c *c;
+
+  if(n < 1 || n > LCD_MAX_DISPLAYS)
+    return NULL;
+
+  c = calloc(1, sizeof(*c));
+  if(c == NULL)
+    return NULL;
+
+  c->fd = -1;
+  c->slave = -1;
+  c->n = n;
+  c->batch = batch;
+
+  c->t.name = "i2c";
+  c->t.bus = LCD_BUS_4BIT;
+  c->t.flags = 0;
+  c->t.burst = LCD_QUEUE;
+  c->t.write = lcd_i2c_write;
+  c->t.write_nibble = lcd_i2c_write_nibble;
+  c->t.sync = NULL;
+  c->t.close = lcd_i2c_close;
+
+  return c;
+}
+
+
+
+// Ouverture de l'adaptateur "dev" ; l'afficheur "i" est derrière
+// l'expandeur d'adresse addr[i]
+struct lcd_transport *lcd_i2c_open(const char *dev, const int *addr, int n,
+                                   size_t batch){
+  struct lcd_i2c *c;
+  unsigned long funcs;
+
+  c = lcd_i2c_alloc(n, batch);
+  if(c == NULL)
+    return NULL;
+
+  memcpy(c->addr, addr, n * sizeof(int));
+
+  c->fd = open(dev, O_RDWR);
+  if(c->fd < 0 || ioctl(c->fd, I2C_FUNCS, &funcs) < 0){
+    lcd_i2c_close(&c->t);
+    return NULL;
+  }
+
+  // i2c-stub, par exemple, ne connaît que les transferts SMBus
+  if(funcs & I2C_FUNC_I2C)
+    c->mode = I2C_MODE_RDWR;
+  else if(funcs & I2C_FUNC_SMBUS_WRITE_I2C_BLOCK)
+    c->mode = I2C_MODE_BLOCK;
+  else if(funcs & I2C_FUNC_SMBUS_WRITE_BYTE)
+    c->mode = I2C_MODE_BYTE;
+  else{
+    lcd_i2c_close(&c->t);
+    return NULL;
+  }
+
+  return &c->t;
+}
+
+
+
+// Ouverture d'expandeurs simulés : chaque octet fixe les 8 broches d'un
+// banc simulé câblé comme le module
+struct lcd_transport *lcd_i2c_sim_open(int n, size_t batch){
+  struct lcd_pins pins;
+  struct lcd_i2c *c;
+  int i;
+
+  c = lcd_i2c_alloc(n, batch);
+  if(c == NULL)
+    return NULL;
+
+  memset(&pins, 0, sizeof(pins));
+  pins.bus = LCD_BUS_4BIT;
+  pins.rs = 0;
+  for(i=0;i<4;i++)
+    pins.data[i] = 4 + i;
+  pins.en[0] = 2;
+  pins.n = 1;
+
+  c->mode = I2C_MODE_SIM;
+  c->t.name = "i2c-sim";
+  for(c->n=0;c->n<n;c->n++){
+    c->sim[c->n] = lcd_sim_create(&pins);
+    if(c->sim[c->n] == NULL){
+      lcd_i2c_close(&c->t);
+      return NULL;
+    }
+  }
+
+  return &c->t;
+}
+
+
+
+struct lcd_sim *lcd_i2c_sim_get(struct lcd_transport *t, int display){
+  return ((struct lcd_i2c *)t)->sim[display];
+}
@@ -0,0 +1,241 @@
+/*
+ * liblcd: contrôleur HD44780 et banc GPIO simulés.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcd_bus.h"
+#include "lcd_sim.h"
+
+
+// Temps d'exécution (us) annoncés par la documentation du HD44780
+#define LCD_SIM_EXEC       37
+#define LCD_SIM_EXEC_CLEAR 1520
+
+
+
+// Compteur d'adresse suivant et précédent en mode deux lignes :
+// 0x27 est suivi de 0x40, et 0x67 de 0x00
+static unsigned char sim_next(unsigned char ac){
+  if(ac == 0x27)
+    return 0x40;
+  if(ac == 0x67)
+    return 0x00;
+  return ac + 1;
+}
+
+static unsigned char sim_prev(unsigned char ac){
+  if(ac == 0x40)
+    return 0x27;
+  if(ac == 0x00)
+    return 0x67;
+  return ac - 1;
+}
+
+
+
+// Décalage de l'affichage d'une case (vers la gauche si "left")
+static void sim_shift(struct lcd_sim_display *d, int left){
+  d->origin = (d->origin + (left ? 1 : LCD_DDRAM_LINE - 1)) % LCD_DDRAM_LINE;
+}
+
+
+
+// Exécution d'une commande ou d'une donnée complète
+static void sim_exec(struct lcd_sim_display *d, int rs, unsigned char v){
+  unsigned int exec = LCD_SIM_EXEC;
+
+  if(rs){
+    d->data++;
+    if(!d->cgram){
+      d->ddram[d->ac] = v;
+      d->ac = d->increment ? sim_next(d->ac) : sim_prev(d->ac);
+      if(d->shift)
+        sim_shift(d, d->increment);
+    }
+  }
+  else{
+    d->cmds++;
+    if(v & 0x80){
+      d->ac = v & 0x7f;
+      d->cgram = 0;
+    }
+    else if(v & 0x40){
+      d->cgram = 1;
+    }
+    else if(v & 0x20){
+      d->bus = (v & 0x10) ? LCD_BUS_8BIT : LCD_BUS_4BIT;
+    }
+    else if(v & 0x10){
+      if(v & 0x08)
+        sim_shift(d, !(v & 0x04));
+      else
+        d->ac = (v & 0x04) ? sim_next(d->ac) : sim_prev(d->ac);
+    }
+    else if(v & 0x08){
+      d->on = (v & 0x04) != 0;
+    }
+    else if(v & 0x04){
+      d->increment = (v & 0x02) != 0;
+      d->shift = (v & 0x01) != 0;
+    }
+    else if(v & 0x02){
+      d->ac = 0;
+      d->origin = 0;
+      exec = LCD_SIM_EXEC_CLEAR;
+    }
+    else if(v & 0x01){
+      memset(d->ddram, ' ', sizeof(d->ddram));
+      d->ac = 0;
+      d->origin = 0;
+      d->increment = 1;
+      exec = LCD_SIM_EXEC_CLEAR;
+    }
+  }
+
+  d->busy_until = lcd_now_us() + exec;
+}
+
+
+
+// Front descendant sur EN : lecture de RS et des données
+static void sim_latch(struct lcd_sim *sim, struct lcd_sim_display *d){
+  unsigned char v = 0;
+  int rs = (sim->level >> sim->pins.rs) & 0x1;
+  int i;
+
+  for(i=0;i<sim->pins.bus;i++){
+    if(sim->level & (1u << sim->pins.data[i]))
+      v |= 1 << i;
+  }
+
+  // Sur un bus 4 bits, seules les entrées DB4-DB7 sont câblées
+  if(sim->pins.bus == LCD_BUS_4BIT)
+    v <<= 4;
+
+  d->strobes++;
+  if(lcd_now_us() < d->busy_until)
+    d->violations++;
+
+  if(d->bus == LCD_BUS_8BIT){
+    sim_exec(d, rs, v);
+  }
+  else if(!d->half){
+    d->high = v & 0xf0;
+    d->half = 1;
+  }
+  else{
+    d->half = 0;
+    sim_exec(d, rs, d->high | (v >> 4));
+  }
+}
+
+
+
+int lcd_sim_update_mask(struct lcd_sim *sim, unsigned int set,
+                        unsigned int clear){
+  unsigned int old = sim->level;
+  unsigned int en;
+  int i;
+
+  sim->level = (sim->level | set) & ~clear;
+
+  for(i=0;i<sim->pins.n;i++){
+    en = 1u << sim->pins.en[i];
+    if((old & en) && !(sim->level & en))
+      sim_latch(sim, &sim->disp[i]);
+  }
+
+  return 0;
+}
+
+
+
+// Caractères affichés sur la ligne "row" de l'écran 4x20
+void lcd_sim_row(const struct lcd_sim_display *d, int row, char *buf){
+  int base = (row & 1) ? 0x40 : 0x00;
+  int offset = (row & 2) ? LCD_COLS : 0;
+  int c;
+
+  for(c=0;c<LCD_COLS;c++){
+    buf[c] = d->ddram[base + (offset + c + d->origin) % LCD_DDRAM_LINE];
+  }
+  buf[LCD_COLS] = '\0';
+}
+
+
+
+// Création du banc simulé : contrôleurs dans leur état de mise sous tension
+struct lcd_sim *lcd_sim_create(const struct lcd_pins *pins){
+  struct lcd_sim *sim;
+  int i;
+
+  sim = calloc(1, sizeof(*sim));
+  if(sim == NULL)
+    return NULL;
+
+  sim->pins = *pins;
+  for(i=0;i<LCD_MAX_DISPLAYS;i++){
+    memset(sim->disp[i].ddram, ' ', sizeof(sim->disp[i].ddram));
+    sim->disp[i].increment = 1;
+    sim->disp[i].bus = LCD_BUS_8BIT;
+  }
+
+  return sim;
+}
+
+
+
+void lcd_sim_destroy(struct lcd_sim *sim){
+  free(sim);
+}
+
+
+
+// Transport simulé : le bus parallèle, branché sur le banc simulé
+struct lcd_sim_transport {
+  struct lcd_bus bus;
+  struct lcd_sim *sim;
+};
+
+
+static int lcd_sim_bus_update_mask(void *ctx, unsigned int set,
+                                   unsigned int clear){
+  return lcd_sim_update_mask(ctx, set, clear);
+}
+
+
+static void lcd_sim_close(struct lcd_transport *t){
+  struct lcd_sim_transport *s = (struct lcd_sim_transport *)t;
+
+  lcd_sim_destroy(s->sim);
+  free(s);
+}
+
+
+struct lcd_sim *lcd_sim_get(struct lcd_transport *t){
+  return ((struct lcd_sim_transport *)t)->sim;
+}
+
+
+struct lcd_transport *lcd_sim_open(const struct lcd_pins *pins){
+  struct lcd_sim_transport *s;
+
+  s = calloc(1, sizeof(*s));
+  if(s == NULL)
+    return NULL;
+
+  if(lcd_bus_init(&s->bus, pins) == -1 ||
+     (s->sim = lcd_sim_create(pins)) == NULL){
+    free(s);
+    return NULL;
+  }
+
+  s->bus.t.name = "sim";
+  s->bus.t.close = lcd_sim_close;
+  s->bus.update_mask = lcd_sim_bus_update_mask;
+  s->bus.ctx = s->sim;
+
+  return &s->bus.t;
+}
@@ -0,0 +1,81 @@
+#ifndef _LCD_SIM_H_
+#define _LCD_SIM_H_
+
+#include "lcd.h"
+
+/*
+ * Simulated HD44780 controller, latching RS and the data lines on each
+ * falling edge of its EN line.
+ */
+
+struct lcd_sim_display {
+  unsigned char ddram[0x80];
+  unsigned char ac;          /* address counter */
+  int origin;                /* display shift, in cells */
+  int increment;             /* entry mode I/D */
+  int shift;                 /* entry mode S */
+  int on;
+  int bus;                   /* 8 after power on, 4 after a 4-bit function set */
+  int half;                  /* high nibble latched, low nibble expected */
+  unsigned char high;
+  int cgram;                 /* address counter points to the CGRAM */
+  unsigned long long busy_until;
+  unsigned long strobes, cmds, data, violations;
+};
+
+/*
+ * Simulated GPIO bank: the level of the first 32 pins, and the
+ * controllers wired to them as described by 'pins'.
+ */
+
+struct lcd_sim {
+  struct lcd_pins pins;
+  unsigned int level;
+  struct lcd_sim_display disp[LCD_MAX_DISPLAYS];
+};
+
+/*
+ * Create the simulated bank and its controllers, in their power-on
+ * state. Return NULL in case of error.
+ */
+
+struct lcd_sim *
+lcd_sim_create ( const struct lcd_pins *pins );
+
+void
+lcd_sim_destroy ( struct lcd_sim *sim );
+
+/*
+ * Drive the pins of 'set' high and those of 'clear' low, as a write to
+ * GPSET0 then GPCLR0 would. Falling edges on EN lines are latched by
+ * the controllers.
+ */
+
+int
+lcd_sim_update_mask ( struct lcd_sim *sim, unsigned int set,
+                      unsigned int clear );
+
+/*
+ * Simulated bank behind a transport opened by lcd_sim_open().
+ */
+
+struct lcd_sim *
+lcd_sim_get ( struct lcd_transport *t );
+
+/*
+ * Simulated bank behind expander 'display' of a transport opened by
+ * lcd_i2c_sim_open().
+ */
+
+struct lcd_sim *
+lcd_i2c_sim_get ( struct lcd_transport *t, int display );
+
+/*
+ * Copy the LCD_COLS characters shown on row 'row' of the 4x20 screen
+ * into 'buf', followed by a null character.
+ */
+
+void
+lcd_sim_row ( const struct lcd_sim_display *d, int row, char *buf );
+
+#endif
@@ -0,0 +1,502 @@
+/*
+ * Lab3: developing a Linux device driver.
+ *
+ * Push button module for the bcm2708 board family, companion of
+ * bcm2708_lcd: interrupt driven, debounced in the kernel.
+ *
+ */
+
+/* Required headers. */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cdev.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/uaccess.h>
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+
+/* For the event FIFO */
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+
+/* For the debounce timers */
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+
+#include "bcm2708_btn.h"
+
+
+/* The name of the driver. */
+#define BCM2708_BTN_DRIVER_NAME "bcm2708_btn"
+
+
+/* Modinfo - Informations about this module */
+MODULE_AUTHOR("NASR ALLAH Mounir");
+MODULE_DESCRIPTION("Boutons poussoirs, par interruptions et avec anti-rebond");
+MODULE_SUPPORTED_DEVICE("Raspberry Pi - BCM2708");
+MODULE_LICENSE("GPL");
+
+
+/* Buttons of the lab board (TME-1/boutons) */
+#define BTN_GPIO_0          18
+#define BTN_GPIO_1          23
+
+/* Events kept per open file (power of 2) */
+#define BTN_FIFO_SIZE       64
+
+
+
+/*
+ * Module parameters. The default lines are those of the first lab
+ * board: with the LCD board, RS and EN use them, so "gpios" must then
+ * name other lines.
+ */
+static int gpios[BCM2708_BTN_MAX] = { BTN_GPIO_0, BTN_GPIO_1 };
+static int gpios_nr = 2;
+static int debounce = 5000;
+static bool active_low;
+
+module_param_array ( gpios, int, &gpios_nr, 0444 );
+MODULE_PARM_DESC ( gpios, "GPIO de chaque bouton" );
+module_param ( debounce, int, 0444 );
+MODULE_PARM_DESC ( debounce, "Durée de l'anti-rebond, en µs (5000 par défaut)" );
+module_param ( active_low, bool, 0444 );
+MODULE_PARM_DESC ( active_low, "Bouton appuyé au niveau bas" );
+
+
+
+/*
+ * A button: its line, its interrupt and its debounce timer.
+ *
+ * Every edge (re)starts the timer, so that it expires "debounce" µs
+ * after the last bounce; the level is then stable and read once. The
+ * lock is taken by the interrupt handler and the timer, which may run
+ * on different CPUs.
+ */
+struct bcm2708_btn
+{
+  int  id;
+  int  gpio;
+  int  irq;
+  char label[24];
+
+  struct hrtimer timer;
+  spinlock_t     lock;
+
+  /* Dernier état stable (1 : appuyé) */
+  int state;
+
+  /* Une série de rebonds est en cours, commencée à "first" */
+  int     bouncing;
+  ktime_t first;
+};
+
+
+
+/* Un fichier ouvert reçoit tous les événements postérieurs à son
+   ouverture, dans sa propre file. La file est remplie sous
+   "bcm2708_btn_lock" et vidée sous "read_lock" : un seul écrivain et
+   un seul lecteur à la fois, comme le veut kfifo. */
+struct bcm2708_btn_file
+{
+  /* Chaînage dans bcm2708_btn_files */
+  struct list_head list;
+
+  DECLARE_KFIFO ( fifo, struct bcm2708_btn_event, BTN_FIFO_SIZE );
+  struct mutex read_lock;
+
+  /* Événements perdus, file pleine */
+  unsigned long lost;
+};
+
+
+
+static struct bcm2708_btn bcm2708_btn_buttons[BCM2708_BTN_MAX];
+
+/* Fichiers ouverts, et lecteurs en attente d'événement */
+static LIST_HEAD ( bcm2708_btn_files );
+static DEFINE_SPINLOCK ( bcm2708_btn_lock );
+static DECLARE_WAIT_QUEUE_HEAD ( bcm2708_btn_wq );
+
+/* Périphérique caractère, et son nombre majeur */
+static struct cdev bcm2708_btn_cdev;
+static int bcm2708_btn_major;
+
+
+
+
+/* Level of the line, as a button state */
+static
+inline
+int
+bcm2708_btn_pressed ( struct bcm2708_btn * btn )
+{
+  return !gpio_get_value ( btn->gpio ) == !!active_low;
+}
+
+
+
+/* Hand an event to every open file */
+static
+void
+bcm2708_btn_push ( const struct bcm2708_btn_event * ev )
+{
+  struct bcm2708_btn_file * ctx;
+  unsigned long flags;
+
+  spin_lock_irqsave ( &bcm2708_btn_lock, flags );
+  list_for_each_entry ( ctx, &bcm2708_btn_files, list ) {
+    if ( kfifo_in ( &ctx->fifo, ev, 1 ) == 0 ) {
+      ctx->lost++;
+    }
+  }
+  spin_unlock_irqrestore ( &bcm2708_btn_lock, flags );
+
+  wake_up_interruptible ( &bcm2708_btn_wq );
+}
+
+
+
+/* Edge on a button line: the timestamp is taken here, the level is
+   read once the bounces are over. */
+static
+irqreturn_t
+bcm2708_btn_irq ( int    irq
+                , void * data )
+{
+  struct bcm2708_btn * btn = data;
+  ktime_t now = ktime_get ();
+
+  spin_lock ( &btn->lock );
+  if ( !btn->bouncing ) {
+    btn->bouncing = 1;
+    btn->first = now;
+  }
+  hrtimer_start ( &btn->timer, ns_to_ktime ( ( u64 ) debounce * NSEC_PER_USEC ),
+                  HRTIMER_MODE_REL );
+  spin_unlock ( &btn->lock );
+
+  return IRQ_HANDLED;
+}
+
+
+
+/* No edge for "debounce" µs: the level is stable */
+static
+enum hrtimer_restart
+bcm2708_btn_settle ( struct hrtimer * timer )
+{
+  struct bcm2708_btn * btn = container_of ( timer, struct bcm2708_btn, timer );
+  struct bcm2708_btn_event ev;
+  unsigned long flags;
+  int pressed;
+
+  spin_lock_irqsave ( &btn->lock, flags );
+  btn->bouncing = 0;
+  pressed = bcm2708_btn_pressed ( btn );
+
+  /* Parasite, ou appui et relâchement dans la même série */
+  if ( pressed == btn->state ) {
+    spin_unlock_irqrestore ( &btn->lock, flags );
+    return HRTIMER_NORESTART;
+  }
+
+  btn->state = pressed;
+  ev.timestamp = ktime_to_ns ( btn->first );
+  ev.button = btn->id;
+  ev.pressed = pressed;
+  spin_unlock_irqrestore ( &btn->lock, flags );
+
+  bcm2708_btn_push ( &ev );
+
+  return HRTIMER_NORESTART;
+}
+
+
+
+
+/* Request the line and the interrupt of button 'i' */
+static
+int
+bcm2708_btn_setup ( struct bcm2708_btn * btn
+                  , int                  i )
+{
+  int err;
+
+  btn->id = i;
+  btn->gpio = gpios[i];
+  snprintf ( btn->label, sizeof ( btn->label ), "bcm2708_btn%d", i );
+  spin_lock_init ( &btn->lock );
+  hrtimer_init ( &btn->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+  btn->timer.function = bcm2708_btn_settle;
+
+  if ( !gpio_is_valid ( btn->gpio ) ) {
+    printk ( KERN_ALERT "button gpio %d is not valid.\n", btn->gpio );
+    return -EINVAL;
+  }
+
+  err = gpio_request_one ( btn->gpio, GPIOF_IN, btn->label );
+  if ( err ) {
+    return err;
+  }
+
+  /* The level is read from the timer interrupt. */
+  if ( gpio_cansleep ( btn->gpio ) ) {
+    printk ( KERN_ALERT "button gpio %d may sleep.\n", btn->gpio );
+    err = -EINVAL;
+    goto free;
+  }
+
+  btn->irq = gpio_to_irq ( btn->gpio );
+  if ( btn->irq < 0 ) {
+    err = btn->irq;
+    goto free;
+  }
+
+  btn->state = bcm2708_btn_pressed ( btn );
+
+  err = request_irq ( btn->irq, bcm2708_btn_irq,
+                      IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+                      btn->label, btn );
+  if ( err ) {
+    goto free;
+  }
+
+  return 0;
+
+free:
+  gpio_free ( btn->gpio );
+  return err;
+}
+
+
+
+/* Release button 'btn': no more interrupt, then no more timer */
+static
+void
+bcm2708_btn_release ( struct bcm2708_btn * btn )
+{
+  free_irq ( btn->irq, btn );
+  hrtimer_cancel ( &btn->timer );
+  gpio_free ( btn->gpio );
+}
+
+
+
+
+/* Operation d'ouverture : le fichier reçoit sa file d'événements */
+int
+bcm2708_btn_open ( struct inode * inodep
+                 , struct file *  filep )
+{
+    struct bcm2708_btn_file * ctx;
+    unsigned long flags;
+
+    ctx = kzalloc ( sizeof ( *ctx ), GFP_KERNEL );
+    if ( ctx == NULL ) {
+      return -ENOMEM;
+    }
+
+    INIT_KFIFO ( ctx->fifo );
+    mutex_init ( &ctx->read_lock );
+
+    spin_lock_irqsave ( &bcm2708_btn_lock, flags );
+    list_add_tail ( &ctx->list, &bcm2708_btn_files );
+    spin_unlock_irqrestore ( &bcm2708_btn_lock, flags );
+
+    filep->private_data = ctx;
+
+    return 0;
+}
+
+
+
+
+/* Operation de fermeture */
+int
+bcm2708_btn_close ( struct inode * inodep
+                  , struct file *  filep )
+{
+    struct bcm2708_btn_file * ctx = filep->private_data;
+    unsigned long flags;
+
+    spin_lock_irqsave ( &bcm2708_btn_lock, flags );
+    list_del ( &ctx->list );
+    spin_unlock_irqrestore ( &bcm2708_btn_lock, flags );
+
+    if ( ctx->lost > 0 ) {
+      printk ( KERN_INFO "bcm2708_btn: %lu events lost.\n", ctx->lost );
+    }
+
+    kfree ( ctx );
+
+    return 0;
+}
+
+
+
+
+/* Opération de lecture : tous les événements en attente qui tiennent
+   dans le tampon, en une copie. Un appel bloquant attend le premier ;
+   avec O_NONBLOCK, on rend -EAGAIN s'il n'y en a pas. */
+ssize_t
+bcm2708_btn_read ( struct file * filep
+                 , char __user * buf
+                 , size_t        length
+                 , loff_t *      ppos )
+{
+    struct bcm2708_btn_file * ctx = filep->private_data;
+    unsigned int copied;
+    ssize_t err;
+
+    if ( length < sizeof ( struct bcm2708_btn_event ) ) {
+      return -EINVAL;
+    }
+
+    if ( mutex_lock_interruptible ( &ctx->read_lock ) ) {
+      return -ERESTARTSYS;
+    }
+
+    while ( kfifo_is_empty ( &ctx->fifo ) ) {
+      if ( filep->f_flags & O_NONBLOCK ) {
+        err = -EAGAIN;
+        goto out;
+      }
+
+      if ( wait_event_interruptible ( bcm2708_btn_wq, !kfifo_is_empty ( &ctx->fifo ) ) ) {
+        err = -ERESTARTSYS;
+        goto out;
+      }
+    }
+
+    // kfifo_to_user ne copie que des événements entiers
+    if ( kfifo_to_user ( &ctx->fifo, buf, length, &copied ) ) {
+      err = -EFAULT;
+    }
+    else {
+      err = copied;
+    }
+
+out:
+    mutex_unlock ( &ctx->read_lock );
+    return err;
+}
+
+
+
+
+/* Opération poll : prêt en lecture quand un événement attend */
+unsigned int
+bcm2708_btn_poll ( struct file * filep
+                 , poll_table *  wait )
+{
+    struct bcm2708_btn_file * ctx = filep->private_data;
+    unsigned int mask = 0;
+
+    poll_wait ( filep, &bcm2708_btn_wq, wait );
+
+    if ( !kfifo_is_empty ( &ctx->fifo ) ) {
+      mask |= POLLIN | POLLRDNORM;
+    }
+
+    return mask;
+}
+
+
+
+
+// Opérations disponibles sur le fichier spécial
+struct file_operations bcm2708_btn_fops = {
+    .owner   = THIS_MODULE,
+    .open    = bcm2708_btn_open,
+    .read    = bcm2708_btn_read,
+    .poll    = bcm2708_btn_poll,
+    .release = bcm2708_btn_close
+};
+
+
+
+
+// Initialisation du module
+static
+int
+__init
+bcm2708_btn_init_module ( void )
+{
+    int   err;
+    int   i;
+    dev_t dev;
+
+    if ( gpios_nr < 1 || debounce < 0 ) {
+      return -EINVAL;
+    }
+
+    // Nombre majeur dynamique, un seul nombre mineur
+    err = alloc_chrdev_region ( &dev, 0, 1, BCM2708_BTN_DRIVER_NAME );
+    if ( err < 0 ) {
+      return err;
+    }
+    bcm2708_btn_major = MAJOR ( dev );
+
+    // Les interruptions peuvent arriver dès request_irq() : sans
+    // fichier ouvert, les événements ne vont nulle part
+    for ( i = 0; i < gpios_nr; i++ ) {
+      err = bcm2708_btn_setup ( &bcm2708_btn_buttons[i], i );
+      if ( err < 0 ) {
+        printk ( KERN_ALERT "Error : button %d (gpio %d).\n", i, gpios[i] );
+        goto release;
+      }
+    }
+
+    cdev_init ( &bcm2708_btn_cdev, &bcm2708_btn_fops );
+    bcm2708_btn_cdev.owner = THIS_MODULE;
+    err = cdev_add ( &bcm2708_btn_cdev, dev, 1 );
+    if ( err < 0 ) {
+      goto release;
+    }
+
+    return 0;
+
+release:
+    while ( --i >= 0 ) {
+      bcm2708_btn_release ( &bcm2708_btn_buttons[i] );
+    }
+    unregister_chrdev_region ( dev, 1 );
+    return err;
+}
+
+
+
+
+/* Désactivation du module */
+static
+void
+__exit
+bcm2708_btn_cleanup_module ( void )
+{
+    int i;
+
+    cdev_del ( &bcm2708_btn_cdev );
+
+    for ( i = 0; i < gpios_nr; i++ ) {
+      bcm2708_btn_release ( &bcm2708_btn_buttons[i] );
+    }
+
+    unregister_chrdev_region ( MKDEV ( bcm2708_btn_major, 0 ), 1 );
+}
+
+
+/* Fonction qui sera appelé pour l'initialisation du module */
+module_init ( bcm2708_btn_init_module );
+
+/* Fonction qui sera appelé pour la suppression du module */
+module_exit ( bcm2708_btn_cleanup_module );
@@ -0,0 +1,32 @@
+/*
+ * Lab3: developing a Linux device driver.
+ *
+ * Events of the bcm2708_btn driver, shared with user space.
+ *
+ */
+
+#ifndef _BCM2708_BTN_H_
+#define _BCM2708_BTN_H_
+
+#include <linux/types.h>
+
+
+/* Nombre maximal de boutons gérés par le module */
+#define BCM2708_BTN_MAX 8
+
+
+/* Un appui ou un relâchement, une fois les rebonds passés.
+
+   read() rend un nombre entier d'événements. "timestamp" est l'instant
+   (CLOCK_MONOTONIC, en ns) de l'interruption du premier front de la
+   série de rebonds : c'est celui du geste, pas celui de la fin de
+   l'anti-rebond. "button" est l'indice du bouton dans le paramètre
+   "gpios" du module. */
+struct bcm2708_btn_event
+{
+  __u64 timestamp;
+  __u32 button;
+  __u32 pressed;
+};
+
+#endif
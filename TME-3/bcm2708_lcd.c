@@ -16,18 +16,70 @@
 #include <linux/errno.h>
 #include <linux/uaccess.h>
 #include <linux/gpio.h>
+#include <linux/string.h>
+#include <linux/bitmap.h>
 
 #include <asm/delay.h>
+#include <linux/delay.h>
 
 
 /* For spinlocks */
 #include <linux/spinlock.h>
 
+/* RS and D0-D3 are written in one operation: through a descriptor array
+   where gpiod_set_array_value() exists, else through the set and clear
+   registers of the controller (all lines sit in its first bank). */
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+#define LCD_GPIOD_ARRAY
+#include <linux/gpio/consumer.h>
+#else
+#include <linux/io.h>
+#include <mach/platform.h>
+#endif
+
+/* access_ok() lost its first argument in 5.0 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,0,0)
+#define bcm2708_lcd_access_ok(type, addr, size) access_ok ( addr, size )
+#else
+#define bcm2708_lcd_access_ok(type, addr, size) access_ok ( type, addr, size )
+#endif
+
+/* For the bus mutex and the flush worker */
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+
+/* For the write FIFO */
+#include <linux/list.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+
+/* For the bus state machine */
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/completion.h>
+
 
 
 /* For ioctl */
 #include <linux/ioctl.h>
 
+/* For mmap */
+#include <linux/mm.h>
+#include <asm/io.h>
+
+/* For statistics */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "bcm2708_lcd.h"
+
+/* Tracepoints, defined here */
+#define CREATE_TRACE_POINTS
+#include "bcm2708_lcd_trace.h"
+
 
 /* The name of the driver. */
 #define BCM2708_LCD_DRIVER_NAME "bcm2708_lcd"
@@ -36,7 +88,9 @@
 /* Modinfo - Informations about this module */
 MODULE_AUTHOR("NASR ALLAH Mounir");
 MODULE_DESCRIPTION("Drivers pour le contrôleur lcd Hitachi HD44780");
+#ifdef MODULE_SUPPORTED_DEVICE
 MODULE_SUPPORTED_DEVICE("Raspberry Pi - BCM2708");
+#endif
 MODULE_LICENSE("GPL");
 
 
@@ -77,54 +131,278 @@ MODULE_LICENSE("GPL");
 // ***  GPIOs definitions
 #define GPIO_NR            6
 #define GPIO_DATA_NR       4
-static const int gpio_data[]={LCD_GPIO_D0,LCD_GPIO_D1,LCD_GPIO_D2,LCD_GPIO_D3};
-
-
-
-
-/* Declare GPIO used to interface the LCD display. */
-static struct gpio bcm2708_lcd_gpios[] = {
-  {
-      .gpio = LCD_GPIO_RS
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_rs"
-  } ,
-  {
-      .gpio = LCD_GPIO_EN
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_en"
-  },
-  {
-    .gpio = LCD_GPIO_D0
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_d0"
-  },
-  {
-    .gpio = LCD_GPIO_D1
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_d1"
-  },
-  {
-    .gpio = LCD_GPIO_D2
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_d2"
-  },
-  {
-    .gpio = LCD_GPIO_D3
-    , .flags = GPIOF_OUT_INIT_LOW
-    , .label = "bcm2708_lcd_d3"
+
+/* Index of each line in the pin map of a display */
+#define GPIO_PIN_RS        0
+#define GPIO_PIN_EN        1
+#define GPIO_PIN_D0        2
+
+/* Lines written together: RS, then D0-D3 */
+#define GPIO_BUS_NR        ( 1 + GPIO_DATA_NR )
+
+/* Maximal number of displays driven by the module */
+#define LCD_MAX_DEVICES    4
+
+
+
+/*
+ * Pin map of each display, from the module parameters: display 'i'
+ * uses rs[i], en[i] and data[4*i] to data[4*i+3] (D0-D3). The default
+ * is the single display of the lab board. Every display has its own
+ * lines, so all of them can be refreshed at the same time.
+ */
+
+static int rs[LCD_MAX_DEVICES]   = { LCD_GPIO_RS };
+static int en[LCD_MAX_DEVICES]   = { LCD_GPIO_EN };
+static int data[LCD_MAX_DEVICES * GPIO_DATA_NR] =
+  { LCD_GPIO_D0, LCD_GPIO_D1, LCD_GPIO_D2, LCD_GPIO_D3 };
+
+static int rs_nr   = 1;
+static int en_nr   = 1;
+static int data_nr = GPIO_DATA_NR;
+
+module_param_array ( rs, int, &rs_nr, 0444 );
+MODULE_PARM_DESC ( rs, "GPIO RS de chaque afficheur" );
+module_param_array ( en, int, &en_nr, 0444 );
+MODULE_PARM_DESC ( en, "GPIO EN de chaque afficheur (un périphérique par GPIO)" );
+module_param_array ( data, int, &data_nr, 0444 );
+MODULE_PARM_DESC ( data, "GPIO D0-D3 de chaque afficheur, à la suite" );
+
+
+
+/*
+ * The bus protocol is a state machine advanced by a high-resolution
+ * timer. Bytes are first queued in a program; bcm2708_lcd_run() arms the
+ * timer and sleeps until the whole program has been clocked out. Each
+ * expiry sets the pins for one edge of EN and arms the next one, so the
+ * CPU is never held while the controller executes a command.
+ */
+
+/* Hold time of EN and of the data lines (us). */
+#define LCD_WAIT_EDGE       50
+
+/* Execution time of an ordinary command and of "Clear"/"Home" (us). */
+#define LCD_WAIT_CMD        50
+#define LCD_WAIT_CLEAR    2000
+
+/* Maximal number of bytes in a program. */
+#define LCD_PROG_SIZE      128
+
+
+/*
+ * Statistics, shown in debugfs. A histogram counts durations by power
+ * of two of microseconds: bucket 'i' holds [2^i, 2^(i+1)) us, bucket 0
+ * also holds shorter ones and the last one longer ones.
+ */
+
+#define LCD_HIST_NR         16
+
+struct bcm2708_lcd_hist
+{
+  unsigned long count[LCD_HIST_NR];
+  u64           total_ns;
+  u64           max_ns;
+};
+
+/* Record a duration. The caller serializes the updates. */
+static
+void
+bcm2708_lcd_hist_add ( struct bcm2708_lcd_hist * h
+                     , u64                       ns )
+{
+  unsigned long us = ( unsigned long ) ( ns / NSEC_PER_USEC );
+  int i = 0;
+
+  while ( us > 1 && i < LCD_HIST_NR - 1 ) {
+    us >>= 1;
+    i++;
+  }
+
+  h->count[i]++;
+  h->total_ns += ns;
+  if ( ns > h->max_ns ) {
+    h->max_ns = ns;
+  }
+}
+
+/* Print a histogram, skipping empty buckets */
+static
+void
+bcm2708_lcd_hist_show ( struct seq_file *               m
+                      , const char *                    name
+                      , const struct bcm2708_lcd_hist * h )
+{
+  unsigned long n = 0;
+  int i;
+
+  for ( i = 0; i < LCD_HIST_NR; i++ ) {
+    n += h->count[i];
+  }
+
+  seq_printf ( m, "%s: %lu, total %llu us, max %llu us\n", name, n,
+               h->total_ns / NSEC_PER_USEC, h->max_ns / NSEC_PER_USEC );
+  for ( i = 0; i < LCD_HIST_NR; i++ ) {
+    if ( h->count[i] > 0 ) {
+      seq_printf ( m, "  %s%6lu us: %lu\n", i == LCD_HIST_NR - 1 ? ">=" : "< ",
+                   i == LCD_HIST_NR - 1 ? 1ul << i : 2ul << i, h->count[i] );
+    }
   }
+}
+
+
+/* One byte (or a lone upper nibble, for the reset sequence) of a program */
+struct bcm2708_lcd_op
+{
+  uint8_t        rs;
+  uint8_t        nibble_only;
+  uint8_t        value;
+  unsigned short wait;   /* after the last falling edge of EN */
+};
+
+/* Phases of a byte: EN up then down, for each nibble. */
+enum
+{
+  LCD_PHASE_HIGH_UP,
+  LCD_PHASE_HIGH_DOWN,
+  LCD_PHASE_LOW_UP,
+  LCD_PHASE_LOW_DOWN
+};
+
+/* The lines of one display and its state machine */
+struct bcm2708_lcd_bus
+{
+  struct gpio           gpios[GPIO_NR];   /* RS, EN, D0-D3 */
+  char                  labels[GPIO_NR][20];
+
+#ifdef LCD_GPIOD_ARRAY
+  struct gpio_desc *    bus_desc[GPIO_BUS_NR];
+  struct gpio_desc *    en_desc;
+#else
+  void __iomem *        regs;
+  /* Register values for each RS (bit 4) and nibble (bits 0-3) */
+  u32                   set_mask[32];
+  u32                   clr_mask[32];
+#endif
+
+  struct hrtimer        timer;
+  struct completion     done;
+  struct bcm2708_lcd_op prog[LCD_PROG_SIZE];
+  int                   n;       /* bytes in the program */
+  int                   pos;     /* byte being sent */
+  int                   phase;
+  int                   id;      /* display number, for the traces */
+
+  /* Statistics */
+  unsigned long         data;    /* data bytes sent */
+  unsigned long         cmds;    /* command bytes and lone nibbles sent */
+  unsigned long         strobes; /* falling edges of EN */
+  u64                   busy_ns; /* time spent running programs */
 };
 
+#ifndef LCD_GPIOD_ARRAY
+
+/* Offsets of the output set and clear registers (bank 0). Writing them
+   only changes the lines whose bit is set, so displays driven at the
+   same time need no common lock. */
+#define GPIO_REG_SET0      0x1c
+#define GPIO_REG_CLR0      0x28
+
+#endif
+
+
+
+
+/* Fill the pin map of display 'i' from the module parameters */
+static
+void
+bcm2708_lcd_bus_pins ( struct bcm2708_lcd_bus * bus
+                     , int                      i )
+{
+  static const char * const names[GPIO_NR] = { "rs", "en", "d0", "d1", "d2", "d3" };
+  int j;
+
+  bus->id = i;
+  bus->gpios[GPIO_PIN_RS].gpio = rs[i];
+  bus->gpios[GPIO_PIN_EN].gpio = en[i];
+  for ( j = 0; j < GPIO_DATA_NR; ++j ) {
+    bus->gpios[GPIO_PIN_D0 + j].gpio = data[i * GPIO_DATA_NR + j];
+  }
+
+  for ( j = 0; j < GPIO_NR; ++j ) {
+    snprintf ( bus->labels[j], sizeof ( bus->labels[j] ),
+               "bcm2708_lcd%d_%s", i, names[j] );
+    bus->gpios[j].flags = GPIOF_OUT_INIT_LOW;
+    bus->gpios[j].label = bus->labels[j];
+  }
+}
+
 
 
 
 /* Release the GPIOs. */
 static
 void
-bcm2708_lcd_release_gpio ( void )
+bcm2708_lcd_release_gpio ( struct bcm2708_lcd_bus * bus )
+{
+#ifndef LCD_GPIOD_ARRAY
+  if ( bus->regs != NULL ) {
+    iounmap ( bus->regs );
+    bus->regs = NULL;
+  }
+#endif
+
+  gpio_free_array(bus->gpios, GPIO_NR);
+}
+
+
+
+/* Prepare the single-operation writes of RS and D0-D3 */
+static
+int
+bcm2708_lcd_setup_bus ( struct bcm2708_lcd_bus * bus )
 {
-  gpio_free_array(bcm2708_lcd_gpios, GPIO_NR);
+#ifdef LCD_GPIOD_ARRAY
+  int i;
+
+  bus->bus_desc[0] = gpio_to_desc ( bus->gpios[GPIO_PIN_RS].gpio );
+  for ( i = 0; i < GPIO_DATA_NR; ++i ) {
+    bus->bus_desc[1 + i] = gpio_to_desc ( bus->gpios[GPIO_PIN_D0 + i].gpio );
+  }
+  bus->en_desc = gpio_to_desc ( bus->gpios[GPIO_PIN_EN].gpio );
+
+#else
+  unsigned int v, i, bit;
+
+  for ( i = 0; i < GPIO_NR; ++i ) {
+    if ( bus->gpios[i].gpio >= 32 ) {
+      printk ( KERN_ALERT "lcd gpio %s (%d) is not in bank 0.\n",
+               bus->gpios[i].label ,
+               bus->gpios[i].gpio );
+      return -EINVAL;
+    }
+  }
+
+  bus->regs = ioremap ( GPIO_BASE, SZ_4K );
+  if ( bus->regs == NULL ) {
+    return -ENOMEM;
+  }
+
+  for ( v = 0; v < 32; ++v ) {
+    bus->set_mask[v] = 0;
+    bus->clr_mask[v] = 0;
+    for ( i = 0; i < GPIO_BUS_NR; ++i ) {
+      bit = 1u << bus->gpios[i == 0 ? GPIO_PIN_RS : GPIO_PIN_D0 + i - 1].gpio;
+      if ( v & ( i == 0 ? 0x10 : 1u << ( i - 1 ) ) ) {
+        bus->set_mask[v] |= bit;
+      }
+      else {
+        bus->clr_mask[v] |= bit;
+      }
+    }
+  }
+#endif
+
+  return 0;
 }
 
 
@@ -132,151 +410,293 @@ bcm2708_lcd_release_gpio ( void )
 /* Set up GPIOs using gpiolib */
 static
 int
-bcm2708_lcd_setup_gpio ( void )
+bcm2708_lcd_setup_gpio ( struct bcm2708_lcd_bus * bus )
 {
 
   int error;
   int i;
 
   for ( i = 0; i < GPIO_NR; ++i ) {
-    if ( !gpio_is_valid(bcm2708_lcd_gpios[i].gpio) ){
+    if ( !gpio_is_valid(bus->gpios[i].gpio) ){
       printk ( KERN_ALERT "lcd gpio %s (%d) is not valid.\n",
-               bcm2708_lcd_gpios[i].label ,
-               bcm2708_lcd_gpios[i].gpio );
+               bus->gpios[i].label ,
+               bus->gpios[i].gpio );
       return -EINVAL;
     }
   }
 
-  error = gpio_request_array(bcm2708_lcd_gpios, GPIO_NR);
+  error = gpio_request_array(bus->gpios, GPIO_NR);
 
   if(error){
     return error;
   }
 
+  /* The pins are driven from the timer interrupt. */
+  for ( i = 0; i < GPIO_NR; ++i ) {
+    if ( gpio_cansleep(bus->gpios[i].gpio) ){
+      printk ( KERN_ALERT "lcd gpio %s (%d) may sleep.\n",
+               bus->gpios[i].label ,
+               bus->gpios[i].gpio );
+      bcm2708_lcd_release_gpio ( bus );
+      return -EINVAL;
+    }
+  }
+
+  error = bcm2708_lcd_setup_bus ( bus );
+  if ( error ) {
+    bcm2708_lcd_release_gpio ( bus );
+    return error;
+  }
+
   return 0;
 }
 
 
 
-/* Simulate a falling edge */
+/* Sleep, outside of a program (power-on delay). */
 static
+inline
 void
-bcm2708_lcd_strobe ( void )
+bcm2708_lcd_wait ( unsigned int us )
 {
-    gpio_set_value ( LCD_GPIO_EN, 1 );
-    udelay ( 50 );
-    gpio_set_value ( LCD_GPIO_EN, 0 );
-    udelay ( 50 );
+    usleep_range ( us, us + us / 4 + 10 );
 }
 
 
 
-/* Send 4 bits to the LCD */
+/* Put RS and a nibble on the bus, in one operation */
 static
+inline
 void
-bcm2708_lcd_write_4bit_value ( uint8_t value )
+bcm2708_lcd_write_4bit_value ( struct bcm2708_lcd_bus * bus
+                             , uint8_t                  rs
+                             , uint8_t                  value )
 {
+#ifdef LCD_GPIOD_ARRAY
+  unsigned long bits = ( rs & 0x1 ) | ( ( value & 0xf ) << 1 );
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,20,0)
+  gpiod_set_array_value ( GPIO_BUS_NR, bus->bus_desc, NULL, &bits );
+#else
+  int values[GPIO_BUS_NR];
   int i;
 
-  for(i=0;i<GPIO_DATA_NR;i++){
-    gpio_set_value(gpio_data[i], value & 0x1);
-    value >>= 1;
+  for ( i = 0; i < GPIO_BUS_NR; ++i ) {
+    values[i] = ( bits >> i ) & 0x1;
   }
+  gpiod_set_array_value ( GPIO_BUS_NR, bus->bus_desc, values );
+#endif
 
-  bcm2708_lcd_strobe();
+#else
+  unsigned int v = ( ( rs & 0x1 ) << 4 ) | ( value & 0xf );
+
+  writel ( bus->set_mask[v], bus->regs + GPIO_REG_SET0 );
+  writel ( bus->clr_mask[v], bus->regs + GPIO_REG_CLR0 );
+#endif
 }
 
 
 
-/* Send 8 bits to the LCD */
+/* Drive EN */
 static
 inline
 void
-bcm2708_lcd_write_value ( uint8_t value )
+bcm2708_lcd_set_en ( struct bcm2708_lcd_bus * bus
+                   , int                      value )
+{
+#ifdef LCD_GPIOD_ARRAY
+  gpiod_set_value ( bus->en_desc, value );
+#else
+  writel ( 1u << bus->gpios[GPIO_PIN_EN].gpio
+         , bus->regs + ( value ? GPIO_REG_SET0 : GPIO_REG_CLR0 ) );
+#endif
+}
+
+
+
+/* Timer expiry: drive one edge of EN and arm the next one */
+static
+enum hrtimer_restart
+bcm2708_lcd_bus_step ( struct hrtimer * timer )
 {
-    /* Write the 4 upper bits. */
-    bcm2708_lcd_write_4bit_value ( value >> 4 );
+    struct bcm2708_lcd_bus * bus = container_of ( timer, struct bcm2708_lcd_bus, timer );
+    struct bcm2708_lcd_op *  op  = &bus->prog[bus->pos];
+    unsigned int             us  = LCD_WAIT_EDGE;
+
+    // The execution time of the last byte has elapsed
+    if ( bus->pos == bus->n ) {
+      complete ( &bus->done );
+      return HRTIMER_NORESTART;
+    }
+
+    // First edge of a byte
+    if ( bus->phase == LCD_PHASE_HIGH_UP
+         || ( bus->phase == LCD_PHASE_LOW_UP && op->nibble_only ) ) {
+      trace_lcd_byte ( bus->id, op->rs, op->nibble_only, op->value );
+    }
+
+    switch ( bus->phase ) {
+
+    case LCD_PHASE_HIGH_UP:
+      bcm2708_lcd_write_4bit_value ( bus, op->rs, op->value >> 4 );
+      bcm2708_lcd_set_en ( bus, 1 );
+      break;
+
+    case LCD_PHASE_LOW_UP:
+      bcm2708_lcd_write_4bit_value ( bus, op->rs, op->value );
+      bcm2708_lcd_set_en ( bus, 1 );
+      break;
+
+    case LCD_PHASE_HIGH_DOWN:
+      bcm2708_lcd_set_en ( bus, 0 );
+      bus->strobes++;
+      break;
+
+    case LCD_PHASE_LOW_DOWN:
+      bcm2708_lcd_set_en ( bus, 0 );
+      bus->strobes++;
+      us = op->wait;
+      break;
+    }
 
-    /* Write the 4 lower bits. */
-    bcm2708_lcd_write_4bit_value ( value );
+    // Next edge. A lone nibble is sent as the low half of a byte.
+    if ( bus->phase != LCD_PHASE_LOW_DOWN ) {
+      bus->phase++;
+    }
+    else if ( ++bus->pos < bus->n ) {
+      op = &bus->prog[bus->pos];
+      bus->phase = op->nibble_only ? LCD_PHASE_LOW_UP : LCD_PHASE_HIGH_UP;
+    }
+
+    // From now rather than from the expiry: after a late expiry,
+    // hrtimer_forward_now() would keep the grid and shorten this delay
+    hrtimer_set_expires ( timer, ktime_add_ns ( ktime_get (), ( u64 ) us * NSEC_PER_USEC ) );
+    return HRTIMER_RESTART;
 }
 
 
 
-/* Send 4 bits command */
+/* Send the program and wait (sleeping) for its end. Called with the
+   bus mutex held, or from module init. */
 static
-inline
 void
-bcm2708_lcd_send_cmd_4bits ( uint8_t value )
+bcm2708_lcd_run ( struct bcm2708_lcd_bus * bus )
 {
-    gpio_set_value ( LCD_GPIO_RS, 0 );
-    bcm2708_lcd_write_4bit_value ( value );
+    ktime_t start;
+
+    if ( bus->n == 0 ) {
+      return;
+    }
+
+    start = ktime_get ();
+
+    bus->pos = 0;
+    bus->phase = bus->prog[0].nibble_only ? LCD_PHASE_LOW_UP
+                                          : LCD_PHASE_HIGH_UP;
+    init_completion ( &bus->done );
+
+    hrtimer_start ( &bus->timer, ktime_set ( 0, 0 ), HRTIMER_MODE_REL );
+    wait_for_completion ( &bus->done );
+
+    bus->busy_ns += ktime_to_ns ( ktime_sub ( ktime_get (), start ) );
+    bus->n = 0;
 }
 
 
 
-/* Send 8 bits command */
+/* Append a byte to the program, sending it first if it is full */
 static
-inline
 void
-bcm2708_lcd_send_cmd ( uint8_t cmd )
+bcm2708_lcd_queue ( struct bcm2708_lcd_bus * bus
+                  , uint8_t                  rs
+                  , uint8_t                  nibble_only
+                  , uint8_t                  value
+                  , unsigned short           wait )
 {
-    gpio_set_value ( LCD_GPIO_RS, 0 );
-    bcm2708_lcd_write_value ( cmd );
+    struct bcm2708_lcd_op * op;
+
+    if ( bus->n == LCD_PROG_SIZE ) {
+      bcm2708_lcd_run ( bus );
+    }
+
+    if ( rs ) {
+      bus->data++;
+    }
+    else {
+      bus->cmds++;
+    }
+
+    op = &bus->prog[bus->n++];
+    op->rs = rs;
+    op->nibble_only = nibble_only;
+    op->value = value;
+    op->wait = wait;
 }
 
 
 
-/* Set position */
+/* Execution time of a command */
 static
 inline
-void
-bcm2708_lcd_set_position ( int x, int y )
+unsigned short
+bcm2708_lcd_cmd_wait ( uint8_t cmd )
 {
-    static uint8_t const row_offset[] = { 0x00, 0x40, 0x14, 0x54 };
-    bcm2708_lcd_send_cmd ( x + ( LCD_CMD_DGRAM | row_offset[y] ) );
+    return ( cmd == LCD_CMD_CLR || cmd == LCD_CMD_HOME ) ? LCD_WAIT_CLEAR
+                                                         : LCD_WAIT_CMD;
 }
 
 
 
-/* Send an char data to the LCD */
+/* Send 4 bits command */
 static
 inline
 void
-bcm2708_lcd_put ( char c )
+bcm2708_lcd_send_cmd_4bits ( struct bcm2708_lcd_bus * bus
+                           , uint8_t                  value
+                           , unsigned short           wait )
 {
-  gpio_set_value ( LCD_GPIO_RS, 1 );
-  bcm2708_lcd_write_value ( ( uint8_t ) c );
+    bcm2708_lcd_queue ( bus, 0, 1, value, wait );
 }
 
 
 
-/* Send an string to the LCD */
+/* Send 8 bits command */
 static
 inline
 void
-bcm2708_lcd_put_string ( const char * str )
+bcm2708_lcd_send_cmd ( struct bcm2708_lcd_bus * bus
+                     , uint8_t                  cmd )
 {
+    bcm2708_lcd_queue ( bus, 0, 0, cmd, bcm2708_lcd_cmd_wait ( cmd ) );
+}
 
-    while ( *str ) {
-      bcm2708_lcd_put ( *str++ );
-    }
-    udelay ( 50 );
 
 
+/* Adresse de la DDRAM du début de chaque ligne de l'écran */
+static uint8_t const bcm2708_lcd_row_offset[] = { 0x00, 0x40, 0x14, 0x54 };
+
+
+
+/* Set position */
+static
+inline
+void
+bcm2708_lcd_set_position ( struct bcm2708_lcd_bus * bus
+                         , int x, int y )
+{
+    bcm2708_lcd_send_cmd ( bus, x + ( LCD_CMD_DGRAM | bcm2708_lcd_row_offset[y] ) );
 }
 
 
 
-/* Envoyer la commande "Home" */
+/* Send an char data to the LCD */
 static
 inline
 void
-bcm2708_lcd_go_home ( void )
+bcm2708_lcd_put ( struct bcm2708_lcd_bus * bus
+                , char                     c )
 {
-    gpio_set_value ( LCD_GPIO_RS, 0 );
-    bcm2708_lcd_send_cmd ( LCD_CMD_HOME );
-    udelay ( 2000 );
+  bcm2708_lcd_queue ( bus, 1, 0, ( uint8_t ) c, LCD_WAIT_CMD );
 }
 
 
@@ -285,11 +705,10 @@ bcm2708_lcd_go_home ( void )
 static
 inline
 void
-bcm2708_lcd_clear ( void )
+bcm2708_lcd_clear ( struct bcm2708_lcd_bus * bus )
 {
-    gpio_set_value ( LCD_GPIO_RS, 0 );
-    bcm2708_lcd_send_cmd ( LCD_CMD_CLR );
-    udelay ( 2000 );
+    bcm2708_lcd_send_cmd ( bus, LCD_CMD_CLR );
+    bcm2708_lcd_run ( bus );
 }
 
 
@@ -297,52 +716,41 @@ bcm2708_lcd_clear ( void )
 /* Initialize the LCD */
 static
 int
-bcm2708_lcd_init ( void )
+bcm2708_lcd_init ( struct bcm2708_lcd_bus * bus )
 {
     int     err;
     uint8_t func;
 
-    err = bcm2708_lcd_setup_gpio ();
+    err = bcm2708_lcd_setup_gpio ( bus );
     if ( err < 0 ) {
         return err;
     }
 
-    udelay ( 2000 );
+    hrtimer_init ( &bus->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+    bus->timer.function = bcm2708_lcd_bus_step;
 
-    /* Command mode. */
-    gpio_set_value ( LCD_GPIO_RS, 0 );
+    bcm2708_lcd_wait ( 2000 );
 
     /* Init 8-bit mode. */
     func = LCD_CMD_FUNC | LCD_CMD_FUNC_DL;
-    bcm2708_lcd_send_cmd_4bits ( func >> 4 );
-    udelay ( 50 );
-    bcm2708_lcd_send_cmd_4bits ( func >> 4 );
-    udelay ( 50 );
-    bcm2708_lcd_send_cmd_4bits ( func >> 4 );
-    udelay ( 50 );
+    bcm2708_lcd_send_cmd_4bits ( bus, func >> 4, 100 );
+    bcm2708_lcd_send_cmd_4bits ( bus, func >> 4, 100 );
+    bcm2708_lcd_send_cmd_4bits ( bus, func >> 4, 100 );
 
     /* Init 4-bit mode. */
     func = LCD_CMD_FUNC;
-    bcm2708_lcd_send_cmd_4bits ( func >> 4 );
-    udelay ( 50 );
+    bcm2708_lcd_send_cmd_4bits ( bus, func >> 4, 100 );
 
     /* Setup rows. */
     func |= LCD_CMD_FUNC_N;
-    bcm2708_lcd_send_cmd ( func );
-    udelay ( 50 );
+    bcm2708_lcd_send_cmd ( bus, func );
 
     /* Remainder of initialization. */
-    bcm2708_lcd_send_cmd ( LCD_CMD_ON_OFF | LCD_CMD_ON_OFF_D );
-    udelay ( 50 );
-
-    bcm2708_lcd_send_cmd ( LCD_CMD_ENTRY | LCD_CMD_ENTRY_ID );
-    udelay ( 50 );
+    bcm2708_lcd_send_cmd ( bus, LCD_CMD_ON_OFF | LCD_CMD_ON_OFF_D );
+    bcm2708_lcd_send_cmd ( bus, LCD_CMD_ENTRY | LCD_CMD_ENTRY_ID );
+    bcm2708_lcd_send_cmd ( bus, LCD_CMD_CDSHIFT | LCD_CMD_CDSHIFT_RL );
 
-    bcm2708_lcd_send_cmd ( LCD_CMD_CDSHIFT | LCD_CMD_CDSHIFT_RL );
-    udelay ( 50 );
-
-    bcm2708_lcd_send_cmd ( LCD_CMD_CLR );
-    udelay ( 2000 );
+    bcm2708_lcd_clear ( bus );
 
     return 0;
 }
@@ -354,190 +762,996 @@ bcm2708_lcd_init ( void )
 static
 inline
 void
-bcm2708_lcd_deinit ( void )
+bcm2708_lcd_deinit ( struct bcm2708_lcd_bus * bus )
 {
     /* Clear display. */
-    bcm2708_lcd_clear ();
+    bcm2708_lcd_clear ( bus );
+
+    /* The program has ended: the timer is idle. */
+    hrtimer_cancel ( &bus->timer );
 
     /* Deinitialize gpios. */
-    bcm2708_lcd_release_gpio ();
+    bcm2708_lcd_release_gpio ( bus );
 
 }
 
 
 
 
-#define BUFFER_SIZE       256  // Taille du buffer
-#define LCD_X               4  // Nombre de lignes
-#define LCD_Y              20  // Nombre de caractères par ligne
+#define BUFFER_SIZE      1024  // Taille de la file d'écriture (puissance de 2)
+#define LCD_X BCM2708_LCD_ROWS  // Nombre de lignes
+#define LCD_Y BCM2708_LCD_COLS  // Nombre de caractères par ligne
 
 
 
-/* Numéro "Magique" du pilote */
-#define BCM2708_LCD_MAGIC 'l'
 
-/* Commande "clear", commande sans argument */
-#define BCM2708_LCD_IOCCLEAR _IO( BCM2708_LCD_MAGIC, 1)
+struct bcm2708_lcd_dev
+{
 
-/* Commande "Home" , commande sans argument */
-#define BCM2708_LCD_IOCHOME _IO( BCM2708_LCD_MAGIC, 2 );
+  /* Peripherique caractère */
+  struct cdev cdev;
 
-/* Récupère le paramètre par valeur */
-#define BCM2708_LCD_IOCQCURPOS _IO( BCM2708_LCD_MAGIC, 3 );
+  /* Image de l'écran voulue, dans une page projetable par mmap() :
+     write() ne fait que la modifier */
+  struct bcm2708_lcd_fb * fb;
 
-/* Récupère le paramètre par pointeur. */
-#define BCM2708_LCD_IOCGCURPOS _IOR( BCM2708_LCD_MAGIC, 4, int )
+  /* Image de l'écran telle qu'elle a été envoyée à l'afficheur */
+  char shown[LCD_X][LCD_Y];
 
-/* Nombre de commandes définis */
-#define BCM2708_LCD_MAXNR 4
+  /* Compteur d'adresse de la DDRAM, -1 s'il est inconnu */
+  int ddram;
 
+  /* Spin lock, Verrou tournant pour gérer la concurence.
+     Il ne protège que "fb", "files" et l'état des fichiers ouverts :
+     il n'est jamais tenu pendant un accès au bus. */
+  spinlock_t lock;
 
+  /* Lignes de l'afficheur et automate du bus */
+  struct bcm2708_lcd_bus bus;
 
+  /* Accès au bus, et à "shown" et "ddram" */
+  struct mutex bus_lock;
 
-struct bcm2708_lcd_dev
-{
+  /* Mise à jour différée de l'afficheur */
+  struct work_struct flush_work;
 
-  /* Peripherique caractère */
-  struct cdev cdev;
+  /* Fichiers ouverts (struct bcm2708_lcd_file) */
+  struct list_head files;
 
-  /* X : position représentant la ligne sélectionné
-     Y : position représentant la position sur la ligne */
-  size_t xpos, ypos;
+  /* Écrivains en attente de place dans leur file */
+  wait_queue_head_t wq;
 
-  /* Buffer */
-  char buffer[BUFFER_SIZE];
+  /* Statistiques, sous "lock" : durée de prise de "lock", durée des
+     appels à write(), octets acceptés par write(), mises à jour */
+  struct bcm2708_lcd_hist lock_hold;
+  struct bcm2708_lcd_hist write_latency;
+  unsigned long written;
+  unsigned long flushes;
+  ktime_t locked_at;
 
-  /* Spin lock, Verrou tournant pour gérer la concurence */
-  spinlock_t lock;
+  /* Répertoire debugfs de l'afficheur */
+  struct dentry * debugfs;
 
 };
 
 
 
+/* Un fichier ouvert : chaque processus écrit dans sa propre région de
+   l'écran, avec sa position et sa file d'écriture. Les régions sont
+   composées dans "fb" ; si elles se recouvrent, le dernier texte placé
+   l'emporte. */
+struct bcm2708_lcd_file
+{
 
-/* Pointeur sur la structure de donnée utilisé par le pilote du LCD */
-static struct bcm2708_lcd_dev * bcm2708_lcdp;
+  struct bcm2708_lcd_dev * lcdp;
 
+  /* Chaînage dans lcdp->files */
+  struct list_head list;
 
-/* Nombre majeur du LCD */
-static int bcm2708_lcd_major;
+  /* Région de l'écran */
+  struct bcm2708_lcd_region region;
 
+  /* X : position représentant la ligne sélectionné
+     Y : position représentant la position sur la ligne
+     (relatives à la région) */
+  size_t xpos, ypos;
 
-/* Operation d'ouverture */
-int
-bcm2708_lcd_open ( struct inode * inodep
-                 , struct file *  filep )
-{
-    struct bcm2708_lcd_dev * lcdp;
+  /* File des octets écrits par write(), pas encore placés dans "fb".
+     "write_lock" sérialise les écrivains ; la file est vidée sous
+     lcdp->lock. */
+  DECLARE_KFIFO ( fifo, char, BUFFER_SIZE );
+  struct mutex write_lock;
 
-    lcdp = container_of( inodep->i_cdev, struct bcm2708_lcd_dev , cdev );
-    filep-> private_data = lcdp;
+  /* Mode terminal : historique de BCM2708_LCD_SCROLLBACK lignes (NULL
+     en mode normal), la ligne "n" étant lines[n % SCROLLBACK]. "last"
+     est la ligne courante, "base" la première après un effacement,
+     "back" le nombre de lignes remontées par BCM2708_LCD_IOCSCROLL. */
+  char ( * lines )[LCD_Y];
+  unsigned int last, base, back;
+
+};
 
-    lcdp->xpos = 0;
-    lcdp->ypos = 0;
 
-    memset(lcdp->buffer,0,sizeof(lcdp->buffer));
 
-    return 0;
+
+/* Prise et libération de "lock", en mesurant la durée de prise */
+static
+inline
+void
+bcm2708_lcd_lock ( struct bcm2708_lcd_dev * lcdp )
+{
+    spin_lock(&(lcdp->lock));
+    lcdp->locked_at = ktime_get ();
+    trace_lcd_lock_acquire ( lcdp->bus.id );
 }
 
+static
+inline
+void
+bcm2708_lcd_unlock ( struct bcm2708_lcd_dev * lcdp )
+{
+    u64 ns = ktime_to_ns ( ktime_sub ( ktime_get (), lcdp->locked_at ) );
+
+    bcm2708_lcd_hist_add ( &lcdp->lock_hold, ns );
+    trace_lcd_lock_release ( lcdp->bus.id, ns );
+    spin_unlock(&(lcdp->lock));
+}
 
 
 
 
-/* Operation de fermeture*/
-int
-bcm2708_lcd_close ( struct inode * inodep
-                  , struct file *  filep )
+/* Déplace le curseur à la position correspondant à une adresse de
+   la DDRAM : les lignes 2 et 3 prolongent les lignes 0 et 1. Le
+   curseur ne bouge pas si la case est hors de la région. Appelé avec
+   "lock" tenu. */
+static
+void
+bcm2708_lcd_cursor_from_ddram ( struct bcm2708_lcd_file * ctx
+                              , uint8_t                   addr )
 {
-    return 0;
-}
+    struct bcm2708_lcd_region * r = &ctx->region;
+    int line = ( addr & 0x40 ) ? 1 : 0;
+    int col  = ( addr & 0x3f ) % ( 2 * LCD_Y );
+    int x    = line + ( col >= LCD_Y ? 2 : 0 );
+    int y    = col % LCD_Y;
+
+    if ( x < r->row || x >= r->row + r->rows
+         || y < r->col || y >= r->col + r->cols ) {
+      return;
+    }
 
+    ctx->xpos = x - r->row;
+    ctx->ypos = y - r->col;
+}
 
 
 
-/* Opération d'écriture  */
-ssize_t
-bcm2708_lcd_write ( struct file * filep
-                  , const char *  buf
-                  , size_t        length
-                  , loff_t *      ppos )
+/* Passe au début de la ligne suivante de la région, en revenant en
+   haut après la dernière. Appelé avec "lock" tenu. */
+static
+void
+bcm2708_lcd_newline ( struct bcm2708_lcd_file * ctx )
 {
-    struct bcm2708_lcd_dev * lcdp;
-    int i;
-    int err;
+    ctx->xpos = ( ctx->xpos + 1 ) % ctx->region.rows;
+    ctx->ypos = 0;
+}
 
-    // le champ pivate_data contient la structure qui représente
-    // le device ( position du curseur, cdev, etc... )
-    lcdp = filep->private_data;
 
 
-    if(length > BUFFER_SIZE){
-      printk ( KERN_ALERT "Error : Size to big.\n");
-      return -1;
-    }
+/* Publie la position courante dans la page projetée, en coordonnées
+   de l'écran. Appelé avec "lock" tenu. */
+static
+inline
+void
+bcm2708_lcd_publish_cursor ( struct bcm2708_lcd_file * ctx )
+{
+    ctx->lcdp->fb->row = ctx->region.row + ctx->xpos;
+    ctx->lcdp->fb->col = ctx->region.col + ctx->ypos;
+}
 
 
-    // On verouille le peripherique, principe du verrou tournant
-    spin_lock(&(lcdp->lock));
 
+/* Place un caractère dans l'image, en coordonnées de l'écran, et
+   marque la case. Appelé avec "lock" tenu. */
+static
+inline
+void
+bcm2708_lcd_set_cell ( struct bcm2708_lcd_dev * lcdp
+                     , int                      row
+                     , int                      col
+                     , char                     c )
+{
+    // Le bit est posé de façon atomique : l'utilisateur peut marquer
+    // d'autres cases du même mot en même temps
+    lcdp->fb->cells[row][col] = c;
+    set_bit ( row * LCD_Y + col, ( unsigned long * ) lcdp->fb->dirty );
+}
 
-    // On copie le buffer de l'utilisateur
-    err = copy_from_user( lcdp->buffer, buf, length );
-    if(err != 0 ){
-      printk ( KERN_ALERT "Error : copy_from_user.\n");
-      return -1;
-    }
 
-    // On va a la position "courante"
-    bcm2708_lcd_set_position( lcdp->xpos, lcdp->ypos );
 
-    // Tant que l'on a des données à envoyer
-    for ( i=0; i<(int)length ; i++ ){
+/* Efface la région. Appelé avec "lock" tenu. */
+static
+void
+bcm2708_lcd_clear_region ( struct bcm2708_lcd_file * ctx )
+{
+    struct bcm2708_lcd_region * r = &ctx->region;
+    int row, col;
 
-      // Saut de ligne, changement de position
-      if((lcdp->buffer)[i]=='\n'){
-        lcdp->xpos++;
-        bcm2708_lcd_set_position(lcdp->xpos, lcdp->ypos );
-      }
-      // Si c'est la fin de la ligne, on passe à la suivante
-      else if(lcdp->ypos >= LCD_Y){
-        lcdp->xpos++;
-        bcm2708_lcd_set_position(lcdp->xpos, lcdp->ypos );
-        bcm2708_lcd_put((lcdp->buffer)[i]);
-        lcdp->ypos++;
-      }
-      // Sinon on écrit un caractère et on incrémente la position
-      else{
-        bcm2708_lcd_put((lcdp->buffer)[i]);
-        lcdp->ypos++;
+    for ( row = r->row; row < r->row + r->rows; row++ ) {
+      for ( col = r->col; col < r->col + r->cols; col++ ) {
+        bcm2708_lcd_set_cell ( ctx->lcdp, row, col, ' ' );
       }
-
     }
+}
 
 
-    // On relache le périphérique
-    spin_unlock(&(lcdp->lock));
-
 
+/* Mode terminal : première ligne de l'historique montrée en haut de
+   la région. Le texte commence en haut de la région, puis la dernière
+   ligne reste en bas. Appelé avec "lock" tenu. */
+static
+unsigned int
+bcm2708_lcd_term_top ( struct bcm2708_lcd_file * ctx )
+{
+    unsigned int rows = ctx->region.rows;
+    unsigned int top;
 
-    // On retourne le nombre de données écrites
-    return i;
+    top = ctx->last - ctx->base >= rows ? ctx->last - rows + 1 : ctx->base;
+    return top - ctx->back;
 }
 
 
 
+/* Mode terminal : place dans l'image la partie de l'historique montrée
+   par la région. Seules les cases qui changent sont marquées : après
+   un défilement, une case qui garde le même caractère ne coûte rien.
+   Appelé avec "lock" tenu. */
+static
+void
+bcm2708_lcd_term_redraw ( struct bcm2708_lcd_file * ctx )
+{
+    struct bcm2708_lcd_dev *    lcdp = ctx->lcdp;
+    struct bcm2708_lcd_region * r = &ctx->region;
+    unsigned int top = bcm2708_lcd_term_top ( ctx );
+    unsigned int line;
+    int row, col;
+    char c;
+
+    for ( row = 0; row < r->rows; row++ ) {
+      line = top + row;
+      for ( col = 0; col < r->cols; col++ ) {
+        c = line <= ctx->last
+            ? ctx->lines[line % BCM2708_LCD_SCROLLBACK][col] : ' ';
+        if ( lcdp->fb->cells[r->row + row][r->col + col] != c ) {
+          bcm2708_lcd_set_cell ( lcdp, r->row + row, r->col + col, c );
+        }
+      }
+    }
 
-/* Implémentation de la fonction ioctl */
+    // Le curseur est sur la ligne courante, même si elle est cachée
+    ctx->xpos = ctx->last - ( top + ctx->back );
+}
+
+
+
+/* Mode terminal : ouvre une nouvelle ligne, vide. Appelé avec "lock"
+   tenu. */
+static
+void
+bcm2708_lcd_term_newline ( struct bcm2708_lcd_file * ctx )
+{
+    ctx->last++;
+    memset ( ctx->lines[ctx->last % BCM2708_LCD_SCROLLBACK], ' ', LCD_Y );
+    ctx->ypos = 0;
+}
+
+
+
+/* Mode terminal : efface la région en gardant l'historique. Appelé
+   avec "lock" tenu. */
+static
+void
+bcm2708_lcd_term_clear ( struct bcm2708_lcd_file * ctx )
+{
+    bcm2708_lcd_term_newline ( ctx );
+    ctx->base = ctx->last;
+    ctx->back = 0;
+    bcm2708_lcd_term_redraw ( ctx );
+}
+
+
+
+/* Écrit un caractère dans la région, à la position courante.
+   Appelé avec "lock" tenu. */
+static
+void
+bcm2708_lcd_render ( struct bcm2708_lcd_file * ctx
+                   , char                      c )
+{
+    // Mode terminal : dans la ligne courante de l'historique, la
+    // région est redessinée après tout le texte
+    if ( ctx->lines != NULL ) {
+      if ( c == '\n' || ctx->ypos >= ctx->region.cols ) {
+        bcm2708_lcd_term_newline ( ctx );
+      }
+      if ( c != '\n' ) {
+        ctx->lines[ctx->last % BCM2708_LCD_SCROLLBACK][ctx->ypos++] = c;
+      }
+      return;
+    }
+
+    // Saut de ligne, changement de position
+    if ( c == '\n' ) {
+      bcm2708_lcd_newline ( ctx );
+      return;
+    }
+
+    // Si c'est la fin de la ligne, on passe à la suivante
+    if ( ctx->ypos >= ctx->region.cols ) {
+      bcm2708_lcd_newline ( ctx );
+    }
+
+    bcm2708_lcd_set_cell ( ctx->lcdp
+                         , ctx->region.row + ctx->xpos
+                         , ctx->region.col + ctx->ypos
+                         , c );
+    ctx->ypos++;
+}
+
+
+
+/* Case de l'écran (ligne * LCD_Y + colonne) où ira le prochain
+   caractère. Appelé avec "lock" tenu. */
+static
+int
+bcm2708_lcd_cursor ( struct bcm2708_lcd_file * ctx )
+{
+    struct bcm2708_lcd_region * r = &ctx->region;
+    size_t x = ctx->xpos, y = ctx->ypos;
+
+    // Fin de ligne : le prochain caractère ouvre la ligne suivante, et
+    // en mode terminal la région défile
+    if ( y >= r->cols ) {
+      x = ctx->lines != NULL ? min_t ( size_t, x + 1, r->rows - 1 )
+                             : ( x + 1 ) % r->rows;
+      y = 0;
+    }
+
+    return ( r->row + x ) * LCD_Y + r->col + y;
+}
+
+
+
+/* Place dans l'image au plus "max" octets de la file d'écriture d'un
+   fichier. Appelé avec "lock" tenu. */
+static
+unsigned int
+bcm2708_lcd_consume ( struct bcm2708_lcd_file * ctx
+                    , unsigned int              max )
+{
+    char chunk[LCD_X * LCD_Y];
+    unsigned int i, n;
+
+    n = kfifo_out ( &ctx->fifo, chunk, min_t ( unsigned int, max, sizeof ( chunk ) ) );
+    for ( i = 0; i < n; i++ ) {
+      bcm2708_lcd_render ( ctx, chunk[i] );
+    }
+    if ( n > 0 ) {
+      if ( ctx->lines != NULL ) {
+        ctx->back = 0;
+        bcm2708_lcd_term_redraw ( ctx );
+      }
+      bcm2708_lcd_publish_cursor ( ctx );
+    }
+
+    return n;
+}
+
+
+
+/* Vide toute la file d'écriture d'un fichier dans l'image. Appelé avec
+   "lock" tenu. */
+static
+unsigned int
+bcm2708_lcd_consume_all ( struct bcm2708_lcd_file * ctx )
+{
+    unsigned int n, total = 0;
+
+    while ( ( n = bcm2708_lcd_consume ( ctx, BUFFER_SIZE ) ) > 0 ) {
+      total += n;
+    }
+
+    return total;
+}
+
+
+
+/* Envoie à l'afficheur les cases de "frame" marquées dans "dirty" qui
+   diffèrent de ce qu'il affiche. Les lignes sont parcourues dans l'ordre de la DDRAM (0, 2,
+   1, 3) et la commande "Set DDRAM address" n'est envoyée que si les
+   cases à écrire ne se suivent pas. Appelé avec "bus_lock" tenu. */
+static
+void
+bcm2708_lcd_update ( struct bcm2708_lcd_dev * lcdp
+                   , char                     frame[LCD_X][LCD_Y]
+                   , const u32 *              dirty )
+{
+    static int const order[LCD_X] = { 0, 2, 1, 3 };
+    int changed = 0, blank = 1;
+    int r, row, col, addr, i;
+
+    for ( row = 0; row < LCD_X; row++ ) {
+      for ( col = 0; col < LCD_Y; col++ ) {
+        i = row * LCD_Y + col;
+        if ( !( dirty[i / 32] & ( 1u << ( i % 32 ) ) ) ) {
+          frame[row][col] = lcdp->shown[row][col];
+        }
+        if ( frame[row][col] != lcdp->shown[row][col] ) changed++;
+        if ( frame[row][col] != ' ' ) blank = 0;
+      }
+    }
+
+    if ( changed == 0 ) {
+      return;
+    }
+
+    // Écran effacé : une commande "Clear" coûte moins qu'une ligne
+    if ( blank && changed > LCD_Y ) {
+      bcm2708_lcd_clear ( &lcdp->bus );
+      memset ( lcdp->shown, ' ', sizeof ( lcdp->shown ) );
+      lcdp->ddram = 0;
+      return;
+    }
+
+    for ( r = 0; r < LCD_X; r++ ) {
+      row = order[r];
+      for ( col = 0; col < LCD_Y; col++ ) {
+        if ( frame[row][col] == lcdp->shown[row][col] ) continue;
+
+        addr = bcm2708_lcd_row_offset[row] + col;
+        if ( addr != lcdp->ddram ) {
+          bcm2708_lcd_set_position ( &lcdp->bus, col, row );
+        }
+
+        bcm2708_lcd_put ( &lcdp->bus, frame[row][col] );
+        lcdp->shown[row][col] = frame[row][col];
+        lcdp->ddram = addr + 1;
+      }
+    }
+
+    bcm2708_lcd_run ( &lcdp->bus );
+}
+
+
+
+/* Tâche de mise à jour de l'afficheur : place un écran de la file
+   d'écriture dans l'image, copie l'image sous le verrou tournant, puis
+   l'envoie sans le tenir. Recommence tant que la file n'est pas vide :
+   un flot de texte avance au rythme de l'afficheur. */
+static
+void
+bcm2708_lcd_flush ( struct work_struct * work )
+{
+    struct bcm2708_lcd_dev *  lcdp;
+    struct bcm2708_lcd_file * ctx;
+    char frame[LCD_X][LCD_Y];
+    u32 dirty[ARRAY_SIZE(lcdp->fb->dirty)];
+    unsigned long sent;
+    unsigned int n;
+    int pending;
+    int i;
+
+    lcdp = container_of ( work, struct bcm2708_lcd_dev, flush_work );
+
+    mutex_lock(&(lcdp->bus_lock));
+
+    do {
+      trace_lcd_flush_start ( lcdp->bus.id, lcdp->fb->generation );
+      sent = lcdp->bus.data + lcdp->bus.cmds;
+
+      // Un écran de texte par fichier, puis une mise à jour.
+      // Les bits sont pris avant les cases : une case marquée ensuite
+      // par l'utilisateur le sera pour la prochaine mise à jour
+      bcm2708_lcd_lock ( lcdp );
+      n = 0;
+      pending = 0;
+      list_for_each_entry ( ctx, &lcdp->files, list ) {
+        n += bcm2708_lcd_consume ( ctx, LCD_X * LCD_Y );
+        pending |= !kfifo_is_empty ( &ctx->fifo );
+      }
+      for ( i = 0; i < ARRAY_SIZE(dirty); i++ ) {
+        dirty[i] = xchg ( &lcdp->fb->dirty[i], 0 );
+      }
+      memcpy ( frame, lcdp->fb->cells, sizeof ( frame ) );
+      bcm2708_lcd_unlock ( lcdp );
+
+      // De la place s'est libérée dans la file
+      if ( n > 0 ) {
+        wake_up_interruptible(&(lcdp->wq));
+      }
+
+      bcm2708_lcd_update ( lcdp, frame, dirty );
+
+      trace_lcd_flush_end ( lcdp->bus.id, lcdp->fb->generation,
+                            lcdp->bus.data + lcdp->bus.cmds - sent );
+
+      lcdp->fb->generation++;
+      lcdp->flushes++;
+
+    } while ( pending );
+
+    mutex_unlock(&(lcdp->bus_lock));
+}
+
+
+
+/* Envoie une commande HD44780 brute, après les écritures en attente,
+   et met à jour l'état du pilote en conséquence */
+static
+void
+bcm2708_lcd_raw_cmd ( struct bcm2708_lcd_file * ctx
+                    , uint8_t                   lcd_cmd )
+{
+    struct bcm2708_lcd_dev * lcdp = ctx->lcdp;
+    int pending;
+    int row, col;
+
+    // Les write() précédents doivent atteindre l'afficheur avant
+    flush_work(&(lcdp->flush_work));
+
+    mutex_lock(&(lcdp->bus_lock));
+    bcm2708_lcd_send_cmd ( &lcdp->bus, lcd_cmd );
+    bcm2708_lcd_run ( &lcdp->bus );
+
+    bcm2708_lcd_lock ( lcdp );
+
+    // Le texte écrit entre-temps est placé avant le déplacement
+    pending = bcm2708_lcd_consume_all ( ctx ) > 0;
+
+    // "Set DDRAM address" : le prochain write() écrit à cette adresse
+    // (en mode terminal, le texte reste dans l'historique)
+    if ( lcd_cmd & LCD_CMD_DGRAM ) {
+      if ( ctx->lines == NULL ) {
+        bcm2708_lcd_cursor_from_ddram ( ctx, lcd_cmd & ~LCD_CMD_DGRAM );
+      }
+      lcdp->ddram = lcd_cmd & ~LCD_CMD_DGRAM;
+    }
+    // "Clear" et "Home" : retour en haut à gauche de la région, ou au
+    // début de la ligne courante en mode terminal
+    else if ( lcd_cmd == LCD_CMD_CLR || lcd_cmd == LCD_CMD_HOME ) {
+      if ( ctx->lines == NULL ) {
+        ctx->xpos = 0;
+      }
+      ctx->ypos = 0;
+      lcdp->ddram = 0;
+
+      // L'afficheur est vide, mais dans l'image seule la région de
+      // l'appelant l'est : les cases des autres fichiers sont marquées
+      // pour que la tâche de mise à jour les réécrive
+      if ( lcd_cmd == LCD_CMD_CLR ) {
+        memset ( lcdp->shown, ' ', sizeof ( lcdp->shown ) );
+        if ( ctx->lines != NULL ) {
+          bcm2708_lcd_term_clear ( ctx );
+        } else {
+          bcm2708_lcd_clear_region ( ctx );
+        }
+        for ( row = 0; row < LCD_X; row++ ) {
+          for ( col = 0; col < LCD_Y; col++ ) {
+            if ( lcdp->fb->cells[row][col] != ' ' ) {
+              set_bit ( row * LCD_Y + col, ( unsigned long * ) lcdp->fb->dirty );
+              pending = 1;
+            }
+          }
+        }
+      }
+    }
+    // Autre commande : on ne sait plus où en est le compteur d'adresse
+    else {
+      lcdp->ddram = -1;
+    }
+
+    bcm2708_lcd_publish_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+
+    mutex_unlock(&(lcdp->bus_lock));
+
+    if ( pending ) {
+      wake_up_interruptible(&(lcdp->wq));
+      schedule_work(&(lcdp->flush_work));
+    }
+}
+
+
+
+/* Place des segments de texte dans la région, sous une seule prise du
+   verrou, après le texte encore dans la file d'écriture */
+static
+long
+bcm2708_lcd_segments ( struct bcm2708_lcd_file * ctx
+                     , unsigned long             arg )
+{
+    struct bcm2708_lcd_dev *      lcdp = ctx->lcdp;
+    struct bcm2708_lcd_region *   r = &ctx->region;
+    struct bcm2708_lcd_segments   req;
+    struct bcm2708_lcd_segment *  segs;
+    struct bcm2708_lcd_segment *  seg;
+    unsigned int i, j;
+
+    if ( copy_from_user ( &req, ( void __user * ) arg, sizeof ( req ) ) ) {
+      return -EFAULT;
+    }
+    if ( req.n == 0 ) {
+      return 0;
+    }
+    if ( req.n > BCM2708_LCD_MAX_SEGMENTS ) {
+      return -EINVAL;
+    }
+
+    segs = kmalloc ( req.n * sizeof ( *segs ), GFP_KERNEL );
+    if ( segs == NULL ) {
+      return -ENOMEM;
+    }
+
+    if ( copy_from_user ( segs
+                        , ( void __user * ) ( unsigned long ) req.segs
+                        , req.n * sizeof ( *segs ) ) ) {
+      kfree ( segs );
+      return -EFAULT;
+    }
+
+    // Tout ou rien : on vérifie les segments avant d'en appliquer un
+    for ( i = 0; i < req.n; i++ ) {
+      seg = &segs[i];
+      if ( seg->row >= r->rows || seg->col >= r->cols || seg->len > r->cols - seg->col ) {
+        kfree ( segs );
+        return -EINVAL;
+      }
+    }
+
+    bcm2708_lcd_lock ( lcdp );
+
+    bcm2708_lcd_consume_all ( ctx );
+
+    for ( i = 0; i < req.n; i++ ) {
+      seg = &segs[i];
+      for ( j = 0; j < seg->len; j++ ) {
+        bcm2708_lcd_set_cell ( lcdp, r->row + seg->row, r->col + seg->col + j, seg->text[j] );
+      }
+    }
+
+    bcm2708_lcd_unlock ( lcdp );
+
+    kfree ( segs );
+
+    wake_up_interruptible(&(lcdp->wq));
+    schedule_work(&(lcdp->flush_work));
+
+    return 0;
+}
+
+
+
+/* Change la région du fichier. Le texte encore dans la file est placé
+   dans l'ancienne région ; la position revient en haut à gauche. */
+static
+long
+bcm2708_lcd_set_region ( struct bcm2708_lcd_file * ctx
+                       , unsigned long             arg )
+{
+    struct bcm2708_lcd_dev * lcdp = ctx->lcdp;
+    struct bcm2708_lcd_region r;
+    int pending;
+
+    if ( copy_from_user ( &r, ( void __user * ) arg, sizeof ( r ) ) ) {
+      return -EFAULT;
+    }
+    if ( r.rows == 0 || r.cols == 0
+         || r.row + r.rows > LCD_X || r.col + r.cols > LCD_Y ) {
+      return -EINVAL;
+    }
+
+    bcm2708_lcd_lock ( lcdp );
+    pending = bcm2708_lcd_consume_all ( ctx ) > 0;
+    ctx->region = r;
+    ctx->xpos = 0;
+    ctx->ypos = 0;
+
+    // Mode terminal : nouvelle ligne en haut de la nouvelle région
+    if ( ctx->lines != NULL ) {
+      bcm2708_lcd_term_clear ( ctx );
+      pending = 1;
+    }
+
+    bcm2708_lcd_publish_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+
+    if ( pending ) {
+      wake_up_interruptible(&(lcdp->wq));
+      schedule_work(&(lcdp->flush_work));
+    }
+
+    return 0;
+}
+
+
+
+/* Passe le fichier en mode terminal ("arg" non nul) ou en mode normal.
+   Le texte encore dans la file est placé dans l'ancien mode. */
+static
+long
+bcm2708_lcd_set_term ( struct bcm2708_lcd_file * ctx
+                     , unsigned long             arg )
+{
+    struct bcm2708_lcd_dev * lcdp = ctx->lcdp;
+    char ( * lines )[LCD_Y] = NULL;
+
+    // L'historique est alloué hors du verrou tournant
+    if ( arg ) {
+      lines = kmalloc ( BCM2708_LCD_SCROLLBACK * LCD_Y, GFP_KERNEL );
+      if ( lines == NULL ) {
+        return -ENOMEM;
+      }
+      memset ( lines, ' ', BCM2708_LCD_SCROLLBACK * LCD_Y );
+    }
+
+    bcm2708_lcd_lock ( lcdp );
+    bcm2708_lcd_consume_all ( ctx );
+
+    // Déjà dans le mode demandé : rien ne change
+    if ( ( ctx->lines != NULL ) == ( lines != NULL ) ) {
+      bcm2708_lcd_unlock ( lcdp );
+      kfree ( lines );
+      return 0;
+    }
+
+    swap ( ctx->lines, lines );
+    ctx->xpos = 0;
+    ctx->ypos = 0;
+
+    if ( ctx->lines != NULL ) {
+      ctx->last = 0;
+      ctx->base = 0;
+      ctx->back = 0;
+      bcm2708_lcd_term_redraw ( ctx );
+    }
+
+    bcm2708_lcd_publish_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+
+    // Ancien historique, en quittant le mode terminal
+    kfree ( lines );
+
+    wake_up_interruptible(&(lcdp->wq));
+    schedule_work(&(lcdp->flush_work));
+
+    return 0;
+}
+
+
+
+/* Mode terminal : montre la région "arg" lignes plus haut dans
+   l'historique, sans remonter plus loin que la plus ancienne ligne
+   gardée. Rend le nombre de lignes remontées. */
+static
+long
+bcm2708_lcd_scroll ( struct bcm2708_lcd_file * ctx
+                   , unsigned long             arg )
+{
+    struct bcm2708_lcd_dev * lcdp = ctx->lcdp;
+    unsigned int top, oldest;
+    long back;
+
+    bcm2708_lcd_lock ( lcdp );
+
+    if ( ctx->lines == NULL ) {
+      bcm2708_lcd_unlock ( lcdp );
+      return -EINVAL;
+    }
+
+    bcm2708_lcd_consume_all ( ctx );
+
+    ctx->back = 0;
+    top = bcm2708_lcd_term_top ( ctx );
+    oldest = ctx->last >= BCM2708_LCD_SCROLLBACK
+             ? ctx->last - BCM2708_LCD_SCROLLBACK + 1 : 0;
+    ctx->back = min_t ( unsigned long, arg, top - oldest );
+    back = ctx->back;
+
+    bcm2708_lcd_term_redraw ( ctx );
+    bcm2708_lcd_publish_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+
+    wake_up_interruptible(&(lcdp->wq));
+    schedule_work(&(lcdp->flush_work));
+
+    return back;
+}
+
+
+
+/* Structures de donnée des afficheurs, une par nombre mineur */
+static struct bcm2708_lcd_dev * bcm2708_lcd_devs[LCD_MAX_DEVICES];
+static int bcm2708_lcd_nr;
+
+
+/* Nombre majeur du LCD */
+static int bcm2708_lcd_major;
+
+
+/* Operation d'ouverture : le fichier reçoit tout l'écran comme région,
+   et sa propre position */
+int
+bcm2708_lcd_open ( struct inode * inodep
+                 , struct file *  filep )
+{
+    struct bcm2708_lcd_dev *  lcdp;
+    struct bcm2708_lcd_file * ctx;
+
+    lcdp = container_of( inodep->i_cdev, struct bcm2708_lcd_dev , cdev );
+
+    ctx = kzalloc ( sizeof ( *ctx ), GFP_KERNEL );
+    if ( ctx == NULL ) {
+      return -ENOMEM;
+    }
+
+    ctx->lcdp = lcdp;
+    ctx->region.rows = LCD_X;
+    ctx->region.cols = LCD_Y;
+    INIT_KFIFO ( ctx->fifo );
+    mutex_init ( &ctx->write_lock );
+
+    bcm2708_lcd_lock ( lcdp );
+    list_add_tail ( &ctx->list, &lcdp->files );
+    bcm2708_lcd_unlock ( lcdp );
+
+    filep-> private_data = ctx;
+
+    return 0;
+}
+
+
+
+
+
+/* Operation de fermeture : le texte encore dans la file est affiché */
 int
-bcm2708_lcd_ioctl(struct inode * inodep
-                  ,struct file * filep
-                  ,unsigned long cmd
+bcm2708_lcd_close ( struct inode * inodep
+                  , struct file *  filep )
+{
+    struct bcm2708_lcd_file * ctx  = filep->private_data;
+    struct bcm2708_lcd_dev *  lcdp = ctx->lcdp;
+    int pending;
+
+    bcm2708_lcd_lock ( lcdp );
+    pending = bcm2708_lcd_consume_all ( ctx ) > 0;
+    list_del ( &ctx->list );
+    bcm2708_lcd_unlock ( lcdp );
+
+    if ( pending ) {
+      schedule_work(&(lcdp->flush_work));
+    }
+
+    kfree ( ctx->lines );
+    kfree ( ctx );
+
+    return 0;
+}
+
+
+
+
+/* Opération d'écriture : le texte est placé dans la file d'écriture,
+   que "flush_work" vide dans l'image puis vers l'afficheur. Un appel
+   bloquant attend qu'il y ait de la place pour tout le texte ; avec
+   O_NONBLOCK, seul ce qui tient dans la file est pris. */
+ssize_t
+bcm2708_lcd_write ( struct file * filep
+                  , const char *  buf
+                  , size_t        length
+                  , loff_t *      ppos )
+{
+    struct bcm2708_lcd_file * ctx;
+    struct bcm2708_lcd_dev *  lcdp;
+    unsigned int copied;
+    size_t done = 0;
+    ssize_t err = 0;
+    ktime_t start = ktime_get ();
+
+    // le champ pivate_data contient la structure qui représente
+    // le fichier ouvert ( région, position du curseur, file, etc... )
+    ctx = filep->private_data;
+    lcdp = ctx->lcdp;
+
+    trace_lcd_write_enter ( lcdp->bus.id, length );
+
+
+    // Un seul écrivain à la fois : les textes ne se mélangent pas
+    if ( mutex_lock_interruptible(&(ctx->write_lock)) ) {
+      trace_lcd_write_exit ( lcdp->bus.id, -ERESTARTSYS );
+      return -ERESTARTSYS;
+    }
+
+    while ( done < length ) {
+
+      // On copie le buffer de l'utilisateur, sans verrou tournant :
+      // la copie peut dormir
+      if ( kfifo_from_user ( &ctx->fifo, buf + done, length - done, &copied ) ) {
+        err = -EFAULT;
+        break;
+      }
+
+      if ( copied > 0 ) {
+        done += copied;
+        schedule_work(&(lcdp->flush_work));
+        continue;
+      }
+
+      // File pleine
+      if ( filep->f_flags & O_NONBLOCK ) {
+        err = -EAGAIN;
+        break;
+      }
+
+      if ( wait_event_interruptible ( lcdp->wq, !kfifo_is_full ( &ctx->fifo ) ) ) {
+        err = -ERESTARTSYS;
+        break;
+      }
+    }
+
+    mutex_unlock(&(ctx->write_lock));
+
+    // Durée de l'appel, attente de place comprise
+    bcm2708_lcd_lock ( lcdp );
+    lcdp->written += done;
+    bcm2708_lcd_hist_add ( &lcdp->write_latency,
+                           ktime_to_ns ( ktime_sub ( ktime_get (), start ) ) );
+    bcm2708_lcd_unlock ( lcdp );
+
+    if ( done > 0 ) {
+      err = done;
+    }
+    trace_lcd_write_exit ( lcdp->bus.id, err );
+
+
+    // On retourne le nombre de données écrites, ou l'erreur si rien
+    // n'a été écrit
+    return err;
+}
+
+
+
+
+/* Opération poll : prêt en écriture quand la file n'est pas pleine */
+unsigned int
+bcm2708_lcd_poll ( struct file * filep
+                 , poll_table *  wait )
+{
+    struct bcm2708_lcd_file * ctx = filep->private_data;
+    unsigned int mask = 0;
+
+    poll_wait ( filep, &ctx->lcdp->wq, wait );
+
+    if ( !kfifo_is_full ( &ctx->fifo ) ) {
+      mask |= POLLOUT | POLLWRNORM;
+    }
+
+    return mask;
+}
+
+
+
+
+/* Implémentation de la fonction ioctl */
+long
+bcm2708_lcd_ioctl(struct file * filep
+                  ,unsigned int cmd
                   ,unsigned long arg ){
 
+  struct bcm2708_lcd_file * ctx  = filep->private_data;
+  struct bcm2708_lcd_dev *  lcdp = ctx->lcdp;
 
   // Erreur et valeur de retour
-  int err = 0, retval, curpos;
+  int err = 0, retval = 0, curpos, pending;
 
 
   // Si le numero magique donne dans la commande est different du
@@ -550,34 +1764,81 @@ bcm2708_lcd_ioctl(struct inode * inodep
   if ( _IOC_NR( cmd ) > BCM2708_LCD_MAXNR ) return -EINVAL;
 
 
-  // Dans le cas où l'on doit lire l'argument, alors on vérifie
-  // que l'on peut accéder à l'adresse donnée par l'utiisateur
+  // _IOC_READ : l'utilisateur lit le résultat, le pilote écrit donc à
+  // l'adresse donnée ; on vérifie qu'il en a le droit
   if ( _IOC_DIR ( cmd ) & _IOC_READ ) {
-    err = access_ok ( VERIFY_READ
-                      , ( void __user * ) arg
-                      , _IOC_SIZE ( cmd ) );
+    err |= !bcm2708_lcd_access_ok ( VERIFY_WRITE
+                                    , ( void __user * ) arg
+                                    , _IOC_SIZE ( cmd ) );
   }
 
 
-  // Dans le cas où l'on doit écrire l'argument, alors on vérifie
-  // que l'on peut accéder à l'adresse donnée par l'utiisateur
-  else if ( _IOC_DIR ( cmd ) & _IOC_WRITE ){
-    err = access_ok ( VERIFY_WRITE
-                      , ( void __user * ) arg
-                      , _IOC_SIZE ( cmd ) );
+  // _IOC_WRITE : l'utilisateur passe l'argument, le pilote le lit
+  if ( _IOC_DIR ( cmd ) & _IOC_WRITE ){
+    err |= !bcm2708_lcd_access_ok ( VERIFY_READ
+                                    , ( void __user * ) arg
+                                    , _IOC_SIZE ( cmd ) );
   }
 
+  // Adresse refusée : __put_user() et consorts ne doivent pas y toucher
+  if ( err ) return -EFAULT;
+
   // Gestion de la commande
   switch ( cmd ) {
 
   // Si la commande cmd est clear
+  // La région est effacée dans l'image ; si c'est tout l'écran,
+  // "flush_work" enverra "Clear"
   case BCM2708_LCD_IOCCLEAR:
-    bcm2708_lcd_clear();
+    // Le texte encore dans la file serait effacé : on l'abandonne
+    bcm2708_lcd_lock ( lcdp );
+    kfifo_reset_out ( &ctx->fifo );
+    if ( ctx->lines != NULL ) {
+      bcm2708_lcd_term_clear ( ctx );
+    }
+    else {
+      bcm2708_lcd_clear_region ( ctx );
+      ctx->xpos = 0;
+      ctx->ypos = 0;
+    }
+    bcm2708_lcd_publish_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+    wake_up_interruptible(&(lcdp->wq));
+    schedule_work(&(lcdp->flush_work));
+    break;
+
+  // Mise à jour avec les cases marquées dans la page projetée
+  case BCM2708_LCD_IOCFLUSH:
+    schedule_work(&(lcdp->flush_work));
+    break;
+
+  // Plusieurs segments de texte positionnés
+  case BCM2708_LCD_IOCSEGMENTS:
+    retval = bcm2708_lcd_segments ( ctx, arg );
+    break;
+
+  // Région du fichier
+  case BCM2708_LCD_IOCSREGION:
+    retval = bcm2708_lcd_set_region ( ctx, arg );
+    break;
+
+  case BCM2708_LCD_IOCGREGION:
+    retval = copy_to_user ( ( void __user * ) arg, &ctx->region, sizeof ( ctx->region ) )
+             ? -EFAULT : 0;
+    break;
+
+  // Mode terminal, et historique
+  case BCM2708_LCD_IOCSTERM:
+    retval = bcm2708_lcd_set_term ( ctx, arg );
+    break;
+
+  case BCM2708_LCD_IOCSCROLL:
+    retval = bcm2708_lcd_scroll ( ctx, arg );
     break;
 
   // Si la commande cmd est Home
   case BCM2708_LCD_IOCHOME :
-    bcm2708_lcd_go_home();
+    bcm2708_lcd_raw_cmd ( ctx, LCD_CMD_HOME );
     break;
 
   // Si la commande "cmd" est de recuperer le paramètre par valeur
@@ -585,13 +1846,28 @@ bcm2708_lcd_ioctl(struct inode * inodep
     retval = arg;
     break;
 
-  // Si la commande "cmd" est de recuperer le paramètre par pointeur
+  // Si la commande "cmd" est de recuperer le curseur par pointeur :
+  // numéro de la case de l'écran où écrira le prochain write()
   case BCM2708_LCD_IOCGCURPOS :
-    retval = __get_user(curpos,( int __user * )arg );
+    // Le texte encore en file est d'abord placé dans l'image
+    bcm2708_lcd_lock ( lcdp );
+    pending = bcm2708_lcd_consume_all ( ctx ) > 0;
+    curpos = bcm2708_lcd_cursor ( ctx );
+    bcm2708_lcd_unlock ( lcdp );
+    if ( pending ) {
+      wake_up_interruptible(&(lcdp->wq));
+      schedule_work(&(lcdp->flush_work));
+    }
+    retval = __put_user ( curpos, ( int __user * ) arg );
+    break;
+
+  // Si la commande "cmd" est une commande HD44780 brute
+  case BCM2708_LCD_IOCCMD :
+    bcm2708_lcd_raw_cmd ( ctx, ( uint8_t ) arg );
     break;
 
   default:
-    return EINVAL;
+    return -EINVAL;
 
   }
 
@@ -603,71 +1879,331 @@ bcm2708_lcd_ioctl(struct inode * inodep
 
 
 
+/* Projection de l'image de l'écran : une page partagée, à l'offset 0 */
+int
+bcm2708_lcd_mmap ( struct file *           filep
+                 , struct vm_area_struct * vma )
+{
+    struct bcm2708_lcd_file * ctx = filep->private_data;
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    // Une copie privée ne verrait pas les mises à jour de write()
+    if ( vma->vm_pgoff != 0 || size > PAGE_SIZE
+         || !( vma->vm_flags & VM_SHARED ) ) {
+      return -EINVAL;
+    }
+
+    return remap_pfn_range ( vma
+                           , vma->vm_start
+                           , virt_to_phys ( ctx->lcdp->fb ) >> PAGE_SHIFT
+                           , size
+                           , vma->vm_page_prot );
+}
+
+
+
+
+/* fsync(), et msync(MS_SYNC) sur la page projetée : mise à jour de
+   l'afficheur, dont on attend la fin */
+int
+bcm2708_lcd_fsync ( struct file * filep
+                  , loff_t        start
+                  , loff_t        end
+                  , int           datasync )
+{
+    struct bcm2708_lcd_dev * lcdp = ( ( struct bcm2708_lcd_file * ) filep->private_data )->lcdp;
+
+    schedule_work(&(lcdp->flush_work));
+    flush_work(&(lcdp->flush_work));
+
+    return 0;
+}
+
+
+
+
+/* Répertoire debugfs du module, un sous-répertoire par afficheur */
+static struct dentry * bcm2708_lcd_debugfs;
+
+
+/* Fichier "stats" : compteurs du bus, écritures et histogrammes */
+static
+int
+bcm2708_lcd_stats_show ( struct seq_file * m
+                       , void *            v )
+{
+    struct bcm2708_lcd_dev * lcdp = m->private;
+    struct bcm2708_lcd_hist lock_hold, write_latency;
+    unsigned long written, flushes;
+    unsigned long data, cmds, strobes;
+    u64 busy_ns;
+
+    // Compteurs du bus : modifiés par la tâche de mise à jour et la
+    // commande brute, toujours sous "bus_lock"
+    mutex_lock(&(lcdp->bus_lock));
+    data = lcdp->bus.data;
+    cmds = lcdp->bus.cmds;
+    strobes = lcdp->bus.strobes;
+    busy_ns = lcdp->bus.busy_ns;
+    mutex_unlock(&(lcdp->bus_lock));
+
+    // Le reste est copié sous "lock", puis affiché sans verrou
+    bcm2708_lcd_lock ( lcdp );
+    written = lcdp->written;
+    flushes = lcdp->flushes;
+    write_latency = lcdp->write_latency;
+    lock_hold = lcdp->lock_hold;
+    bcm2708_lcd_unlock ( lcdp );
+
+    seq_printf ( m, "written: %lu\n", written );
+    seq_printf ( m, "flushes: %lu\n", flushes );
+    seq_printf ( m, "data: %lu\n", data );
+    seq_printf ( m, "commands: %lu\n", cmds );
+    seq_printf ( m, "strobes: %lu\n", strobes );
+    seq_printf ( m, "bus busy: %llu us\n", busy_ns / NSEC_PER_USEC );
+    bcm2708_lcd_hist_show ( m, "write", &write_latency );
+    bcm2708_lcd_hist_show ( m, "lock", &lock_hold );
+
+    return 0;
+}
+
+static
+int
+bcm2708_lcd_stats_open ( struct inode * inodep
+                       , struct file *  filep )
+{
+    return single_open ( filep, bcm2708_lcd_stats_show, inodep->i_private );
+}
+
+static
+const
+struct file_operations bcm2708_lcd_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = bcm2708_lcd_stats_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release
+};
+
+
+/* Fichier "screen" : l'image de l'écran, une ligne par rangée */
+static
+int
+bcm2708_lcd_screen_show ( struct seq_file * m
+                        , void *            v )
+{
+    struct bcm2708_lcd_dev * lcdp = m->private;
+    char frame[LCD_X][LCD_Y];
+    u32 generation;
+    int row;
+
+    bcm2708_lcd_lock ( lcdp );
+    memcpy ( frame, lcdp->fb->cells, sizeof ( frame ) );
+    generation = lcdp->fb->generation;
+    bcm2708_lcd_unlock ( lcdp );
+
+    seq_printf ( m, "generation %u\n", generation );
+    for ( row = 0; row < LCD_X; row++ ) {
+      seq_printf ( m, "|%.*s|\n", LCD_Y, frame[row] );
+    }
+
+    return 0;
+}
+
+static
+int
+bcm2708_lcd_screen_open ( struct inode * inodep
+                        , struct file *  filep )
+{
+    return single_open ( filep, bcm2708_lcd_screen_show, inodep->i_private );
+}
+
+static
+const
+struct file_operations bcm2708_lcd_screen_fops = {
+    .owner   = THIS_MODULE,
+    .open    = bcm2708_lcd_screen_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release
+};
+
+
+
+
 // Opérations disponibles sur le fichier spécial,
 // qui permet à l'utilisateur d'interagir avec le périphérique.
 struct file_operations bcm2708_lcd_fops = {
     .owner   = THIS_MODULE,
     .open    = bcm2708_lcd_open,
     .write   = bcm2708_lcd_write,
-    .ioctl   = bcm2708_lcd_ioctl,
+    .poll    = bcm2708_lcd_poll,
+    .unlocked_ioctl = bcm2708_lcd_ioctl,
+    .mmap    = bcm2708_lcd_mmap,
+    .fsync   = bcm2708_lcd_fsync,
     .release = bcm2708_lcd_close
 };
 
 
 
-// Initialisation du module
+/* Création de l'afficheur de nombre mineur "i" */
 static
 int
-__init
-bcm2708_lcd_init_module ( void )
+bcm2708_lcd_create ( int i )
 {
-    int   err;
-    dev_t dev;
-
+    struct bcm2708_lcd_dev * lcdp;
+    char name[8];
+    int err;
 
-    printk("Bonjour \n");
+    // Allocation de la structure de donnée en utilisant la fonction kzalloc
+    lcdp = kzalloc(sizeof(struct bcm2708_lcd_dev),GFP_KERNEL);
+    if(lcdp == NULL) {
+      printk ( KERN_ALERT "Error : kzalloc in bcm2708_lcd_create.\n");
+      return -ENOMEM;
+    }
 
-    // On récupère dynamiquement un nombre majeur,
-    // Ce qui initialise la structure dev
-    alloc_chrdev_region ( &dev
-                          , 0 /* Premier numéro mineur */
-                          , 1 /* Nombre de périphériques */
-                          , BCM2708_LCD_DRIVER_NAME );
+    // Page de l'image de l'écran, réservée pour pouvoir être projetée
+    lcdp->fb = ( struct bcm2708_lcd_fb * ) get_zeroed_page(GFP_KERNEL);
+    if(lcdp->fb == NULL) {
+      printk ( KERN_ALERT "Error : get_zeroed_page in bcm2708_lcd_create.\n");
+      kfree(lcdp);
+      return -ENOMEM;
+    }
+    SetPageReserved ( virt_to_page ( lcdp->fb ) );
 
 
-    // On récupère le nombre majeur qui a été initialisé dynamiquement
-    bcm2708_lcd_major = MAJOR ( dev );
+    // Initialisation du periphérique caractère
+    cdev_init( &lcdp->cdev, &bcm2708_lcd_fops );
+    lcdp->cdev.owner = THIS_MODULE;
 
-    // Allocation de la structure de donnée en utilisant la fonction kzalloc
-    bcm2708_lcdp = kzalloc(sizeof(struct bcm2708_lcd_dev),GFP_KERNEL);
-    if(bcm2708_lcdp == NULL) {
-      printk ( KERN_ALERT "Error : kzalloc in bcm2708_lcd_init_module.\n");
-      return 5;
-    }
 
+    // Initialisation du spinlock, du mutex du bus et de la tâche
+    // de mise à jour
+    spin_lock_init(&(lcdp->lock));
+    mutex_init(&(lcdp->bus_lock));
+    INIT_WORK(&(lcdp->flush_work), bcm2708_lcd_flush);
+    INIT_LIST_HEAD(&(lcdp->files));
+    init_waitqueue_head(&(lcdp->wq));
 
-    // Initialisation du periphérique caractère
-    cdev_init( &bcm2708_lcdp->cdev, &bcm2708_lcd_fops );
-    bcm2708_lcdp->cdev.owner = THIS_MODULE;
 
+    /* Initialisation du LCD, avant que write() puisse être appelé */
+    bcm2708_lcd_bus_pins ( &lcdp->bus, i );
+    err = bcm2708_lcd_init ( &lcdp->bus );
+    if( err < 0 ){
+      printk ( KERN_ALERT "Error : bcm2708_lcd_init in bcm2708_lcd_create.\n");
+      goto free;
+    }
 
-    // Initialisation du spinlock
-    spin_lock_init(&(bcm2708_lcdp->lock));
+    // L'afficheur vient d'être effacé
+    memset ( lcdp->fb->cells, ' ', sizeof ( lcdp->fb->cells ) );
+    memset ( lcdp->shown, ' ', sizeof ( lcdp->shown ) );
+    lcdp->ddram = 0;
 
 
     // On ajoute le periphérique caratère au noyeau de l'OS
-    err = cdev_add ( &bcm2708_lcdp->cdev, dev, 1 );
+    err = cdev_add ( &lcdp->cdev, MKDEV ( bcm2708_lcd_major, i ), 1 );
     if( err < 0 ){
-      printk ( KERN_ALERT "Error : cdev_init in bcm2708_lcd_init_module.\n");
-      return 6;
+      printk ( KERN_ALERT "Error : cdev_add in bcm2708_lcd_create.\n");
+      bcm2708_lcd_deinit ( &lcdp->bus );
+      goto free;
     }
 
+    // Statistiques : facultatives, une erreur de debugfs est ignorée
+    snprintf ( name, sizeof ( name ), "lcd%d", i );
+    lcdp->debugfs = debugfs_create_dir ( name, bcm2708_lcd_debugfs );
+    debugfs_create_file ( "stats", 0444, lcdp->debugfs, lcdp,
+                          &bcm2708_lcd_stats_fops );
+    debugfs_create_file ( "screen", 0444, lcdp->debugfs, lcdp,
+                          &bcm2708_lcd_screen_fops );
 
-    /* Initialisation du LCD */
-    err = bcm2708_lcd_init();
-    if( err < 0 ){
-      printk ( KERN_ALERT "Error : bcm2708_lcd_init in bcm2708_lcd_init_module.\n");
-      return 7;
+    bcm2708_lcd_devs[i] = lcdp;
+    return 0;
+
+free:
+    ClearPageReserved ( virt_to_page ( lcdp->fb ) );
+    free_page ( ( unsigned long ) lcdp->fb );
+    kfree(lcdp);
+    return err;
+}
+
+
+
+
+/* Suppression d'un afficheur */
+static
+void
+bcm2708_lcd_destroy ( struct bcm2708_lcd_dev * lcdp )
+{
+    /* Plus de statistiques, avant que "lcdp" ne disparaisse */
+    debugfs_remove_recursive ( lcdp->debugfs );
+
+    /* Unregister the chardev driver from the kernel. */
+    cdev_del(&lcdp->cdev);
+
+    /* Plus aucun write() : on abandonne la mise à jour en attente */
+    cancel_work_sync(&(lcdp->flush_work));
+
+    /* Deinitialisation du LCD */
+    bcm2708_lcd_deinit ( &lcdp->bus );
+
+    /* On libère la mémoire alloué pour le peripherique caractère */
+    ClearPageReserved ( virt_to_page ( lcdp->fb ) );
+    free_page ( ( unsigned long ) lcdp->fb );
+    kfree(lcdp);
+}
+
+
+
+
+// Initialisation du module
+static
+int
+__init
+bcm2708_lcd_init_module ( void )
+{
+    int   err;
+    int   i;
+    dev_t dev;
+
+
+    printk("Bonjour \n");
+
+    // Un afficheur par GPIO EN ; chacun a son RS et ses D0-D3
+    bcm2708_lcd_nr = en_nr;
+    if ( rs_nr != en_nr || data_nr != en_nr * GPIO_DATA_NR ) {
+      printk ( KERN_ALERT "Error : %d en, %d rs and %d data pins.\n",
+               en_nr, rs_nr, data_nr );
+      return -EINVAL;
+    }
+
+    // On récupère dynamiquement un nombre majeur,
+    // Ce qui initialise la structure dev
+    err = alloc_chrdev_region ( &dev
+                                , 0 /* Premier numéro mineur */
+                                , bcm2708_lcd_nr /* Nombre de périphériques */
+                                , BCM2708_LCD_DRIVER_NAME );
+    if ( err < 0 ) {
+      return err;
+    }
+
+
+    // On récupère le nombre majeur qui a été initialisé dynamiquement
+    bcm2708_lcd_major = MAJOR ( dev );
+
+    bcm2708_lcd_debugfs = debugfs_create_dir ( BCM2708_LCD_DRIVER_NAME, NULL );
+
+    // Les afficheurs s'initialisent l'un après l'autre, puis sont
+    // indépendants : chacun a son verrou, son bus et sa tâche
+    for ( i = 0; i < bcm2708_lcd_nr; i++ ) {
+      err = bcm2708_lcd_create ( i );
+      if ( err < 0 ) {
+        while ( --i >= 0 ) {
+          bcm2708_lcd_destroy ( bcm2708_lcd_devs[i] );
+        }
+        debugfs_remove_recursive ( bcm2708_lcd_debugfs );
+        unregister_chrdev_region( dev, bcm2708_lcd_nr );
+        return err;
+      }
     }
 
 
@@ -683,22 +2219,18 @@ void
 __exit
 bcm2708_lcd_cleanup_module ( void )
 {
-    dev_t dev;
+    int i;
 
     printk("Bye bye \n");
 
-    /* Deinitialisation du LCD */
-    bcm2708_lcd_deinit();
+    for ( i = 0; i < bcm2708_lcd_nr; i++ ) {
+      bcm2708_lcd_destroy ( bcm2708_lcd_devs[i] );
+    }
 
-    /* Unregister the chardev driver from the kernel. */
-    cdev_del(&bcm2708_lcdp->cdev);
+    debugfs_remove_recursive ( bcm2708_lcd_debugfs );
 
     /* On libère le nombre majeur */
-    dev = MKDEV( bcm2708_lcd_major, 0 );
-    unregister_chrdev_region( dev, 1 );
-
-    /* On libère la mémoire alloué pour le peripherique caractère */
-    kfree(bcm2708_lcdp);
+    unregister_chrdev_region( MKDEV( bcm2708_lcd_major, 0 ), bcm2708_lcd_nr );
 }
 
 
@@ -0,0 +1,135 @@
+/*
+ * Lab3: developing a Linux device driver.
+ *
+ * ioctl interface of the bcm2708_lcd driver, shared with user space.
+ *
+ */
+
+#ifndef _BCM2708_LCD_H_
+#define _BCM2708_LCD_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+
+/* Géométrie de l'écran */
+#define BCM2708_LCD_ROWS  4
+#define BCM2708_LCD_COLS  20
+#define BCM2708_LCD_CELLS ( BCM2708_LCD_ROWS * BCM2708_LCD_COLS )
+
+
+/* Page projetée par mmap() (longueur au plus une page, offset 0,
+   MAP_SHARED).
+
+   L'utilisateur écrit directement dans "cells", marque les cases
+   modifiées dans "dirty" (bit i = case i, ligne par ligne) avec un OU
+   atomique, puis demande la mise à jour par BCM2708_LCD_IOCFLUSH, ou
+   par msync(MS_SYNC) / fsync() qui attendent en plus qu'elle soit
+   faite. Le pilote n'envoie que les cases marquées, efface les bits
+   qu'il prend en compte et incrémente "generation" après chaque mise à
+   jour de l'afficheur. write() utilise la même page : "row" et "col"
+   donnent, en lecture seule, la position sur l'écran après le dernier
+   texte placé. */
+struct bcm2708_lcd_fb
+{
+  __u32 dirty[4];
+  __u32 generation;
+  __u32 row, col;
+  char  cells[BCM2708_LCD_ROWS][BCM2708_LCD_COLS];
+};
+
+
+/* Région rectangulaire de l'écran : "rows" lignes de "cols" cases à
+   partir de la ligne "row", colonne "col". Chaque fichier ouvert a sa
+   région (tout l'écran par défaut) et sa position dans la région ;
+   write(), BCM2708_LCD_IOCCLEAR et les segments s'y limitent. */
+struct bcm2708_lcd_region
+{
+  __u8 row, col, rows, cols;
+};
+
+/* Texte à placer en ligne "row", colonne "col" de la région : "len"
+   octets de "text", sans dépasser la fin de la ligne de la région */
+struct bcm2708_lcd_segment
+{
+  __u8 row, col, len;
+  char text[BCM2708_LCD_COLS];
+};
+
+/* Argument de BCM2708_LCD_IOCSEGMENTS : "n" segments, à l'adresse
+   "segs" (un pointeur converti en entier) */
+struct bcm2708_lcd_segments
+{
+  __u32 n;
+  __u64 segs;
+};
+
+/* Nombre maximal de segments par appel */
+#define BCM2708_LCD_MAX_SEGMENTS 32
+
+/* Lignes gardées par un fichier en mode terminal, ligne courante
+   comprise */
+#define BCM2708_LCD_SCROLLBACK 64
+
+
+/* Numéro "Magique" du pilote */
+#define BCM2708_LCD_MAGIC 'l'
+
+/* Commande "clear", commande sans argument */
+#define BCM2708_LCD_IOCCLEAR _IO( BCM2708_LCD_MAGIC, 1)
+
+/* Commande "Home" , commande sans argument */
+#define BCM2708_LCD_IOCHOME _IO( BCM2708_LCD_MAGIC, 2 )
+
+/* Récupère le paramètre par valeur */
+#define BCM2708_LCD_IOCQCURPOS _IO( BCM2708_LCD_MAGIC, 3 )
+
+/* Récupère par pointeur la position du curseur du fichier : numéro de
+   la case de l'écran (ligne * BCM2708_LCD_COLS + colonne) où écrira le
+   prochain write(). */
+#define BCM2708_LCD_IOCGCURPOS _IOR( BCM2708_LCD_MAGIC, 4, int )
+
+/* Commande HD44780 brute, passée par valeur, envoyée après les write()
+   précédents. Une commande "Set DDRAM address" déplace aussi le curseur
+   utilisé par write() ; une commande "Clear" n'efface que la région du
+   fichier, les autres sont réécrites. */
+#define BCM2708_LCD_IOCCMD _IO( BCM2708_LCD_MAGIC, 5 )
+
+/* Demande la mise à jour de l'afficheur avec les cases marquées dans la
+   page projetée, sans l'attendre */
+#define BCM2708_LCD_IOCFLUSH _IO( BCM2708_LCD_MAGIC, 6 )
+
+/* Place plusieurs segments de texte en un seul appel, sans déplacer le
+   curseur de write(). Tous les segments sont appliqués ensemble, puis
+   l'afficheur est mis à jour en une fois, dans l'ordre de la DDRAM. */
+#define BCM2708_LCD_IOCSEGMENTS _IOW( BCM2708_LCD_MAGIC, 7, struct bcm2708_lcd_segments )
+
+/* Change la région du fichier ouvert, ou la lit */
+#define BCM2708_LCD_IOCSREGION _IOW( BCM2708_LCD_MAGIC, 8, struct bcm2708_lcd_region )
+#define BCM2708_LCD_IOCGREGION _IOR( BCM2708_LCD_MAGIC, 9, struct bcm2708_lcd_region )
+
+/* Mode terminal du fichier ouvert (argument 1), ou mode normal (0).
+
+   En mode terminal, write() écrit dans un historique de lignes et la
+   région en montre les dernières : un saut de ligne, ou la fin d'une
+   ligne de la région, ouvre une nouvelle ligne et, sous la dernière
+   ligne de la région, fait défiler le texte d'une ligne. Seules les
+   cases dont le contenu change sont renvoyées à l'afficheur. La région
+   est effacée au passage en mode terminal ; BCM2708_LCD_IOCCLEAR et la
+   commande "Clear" ouvrent une nouvelle ligne en haut de la région, en
+   gardant l'historique ; "Home" revient au début de la ligne courante ;
+   "Set DDRAM address" ne déplace pas le curseur. Les segments ne durent
+   que jusqu'au prochain texte. */
+#define BCM2708_LCD_IOCSTERM _IO( BCM2708_LCD_MAGIC, 10 )
+
+/* Mode terminal : montre la région "arg" lignes plus haut dans
+   l'historique (0 : les dernières lignes). Rend le nombre de lignes
+   effectivement remontées ; tout nouveau texte ramène aux dernières
+   lignes. */
+#define BCM2708_LCD_IOCSCROLL _IO( BCM2708_LCD_MAGIC, 11 )
+
+/* Nombre de commandes définis */
+#define BCM2708_LCD_MAXNR 11
+
+
+#endif
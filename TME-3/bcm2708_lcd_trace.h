@@ -0,0 +1,176 @@
+/*
+ * Points de trace du pilote bcm2708_lcd.
+ *
+ * Activation : echo 1 > /sys/kernel/debug/tracing/events/bcm2708_lcd/enable
+ * ou enregistrement : perf record -e 'bcm2708_lcd:*'
+ *
+ * Chaque événement porte le numéro de l'afficheur ("lcd").
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bcm2708_lcd
+
+#if !defined(_BCM2708_LCD_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _BCM2708_LCD_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+
+/* Entrée dans write() : "len" octets demandés */
+TRACE_EVENT(lcd_write_enter,
+
+	TP_PROTO(int lcd, size_t len),
+
+	TP_ARGS(lcd, len),
+
+	TP_STRUCT__entry(
+		__field(	int,	lcd	)
+		__field(	size_t,	len	)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->len = len;
+	),
+
+	TP_printk("lcd=%d len=%zu", __entry->lcd, __entry->len)
+);
+
+/* Sortie de write() : octets pris ou erreur */
+TRACE_EVENT(lcd_write_exit,
+
+	TP_PROTO(int lcd, ssize_t ret),
+
+	TP_ARGS(lcd, ret),
+
+	TP_STRUCT__entry(
+		__field(	int,	 lcd	)
+		__field(	ssize_t, ret	)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->ret = ret;
+	),
+
+	TP_printk("lcd=%d ret=%zd", __entry->lcd, __entry->ret)
+);
+
+/* Début d'une mise à jour de l'afficheur par la tâche "flush_work" */
+TRACE_EVENT(lcd_flush_start,
+
+	TP_PROTO(int lcd, u32 generation),
+
+	TP_ARGS(lcd, generation),
+
+	TP_STRUCT__entry(
+		__field(	int,	lcd		)
+		__field(	u32,	generation	)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->generation = generation;
+	),
+
+	TP_printk("lcd=%d generation=%u", __entry->lcd, __entry->generation)
+);
+
+/* Fin de la mise à jour : "bytes" octets envoyés sur le bus */
+TRACE_EVENT(lcd_flush_end,
+
+	TP_PROTO(int lcd, u32 generation, unsigned long bytes),
+
+	TP_ARGS(lcd, generation, bytes),
+
+	TP_STRUCT__entry(
+		__field(	int,		lcd		)
+		__field(	u32,		generation	)
+		__field(	unsigned long,	bytes		)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->generation = generation;
+		__entry->bytes = bytes;
+	),
+
+	TP_printk("lcd=%d generation=%u bytes=%lu",
+		  __entry->lcd, __entry->generation, __entry->bytes)
+);
+
+/* Un octet (ou un quartet seul) part sur le bus, depuis le timer */
+TRACE_EVENT(lcd_byte,
+
+	TP_PROTO(int lcd, int rs, int nibble_only, u8 value),
+
+	TP_ARGS(lcd, rs, nibble_only, value),
+
+	TP_STRUCT__entry(
+		__field(	int,	lcd		)
+		__field(	u8,	rs		)
+		__field(	u8,	nibble_only	)
+		__field(	u8,	value		)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->rs = rs;
+		__entry->nibble_only = nibble_only;
+		__entry->value = value;
+	),
+
+	TP_printk("lcd=%d %s%s 0x%02x", __entry->lcd,
+		  __entry->rs ? "data" : "cmd",
+		  __entry->nibble_only ? " nibble" : "", __entry->value)
+);
+
+/* Prise du verrou tournant de l'afficheur */
+TRACE_EVENT(lcd_lock_acquire,
+
+	TP_PROTO(int lcd),
+
+	TP_ARGS(lcd),
+
+	TP_STRUCT__entry(
+		__field(	int,	lcd	)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+	),
+
+	TP_printk("lcd=%d", __entry->lcd)
+);
+
+/* Libération du verrou, après "hold_ns" ns */
+TRACE_EVENT(lcd_lock_release,
+
+	TP_PROTO(int lcd, u64 hold_ns),
+
+	TP_ARGS(lcd, hold_ns),
+
+	TP_STRUCT__entry(
+		__field(	int,	lcd	)
+		__field(	u64,	hold_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->lcd = lcd;
+		__entry->hold_ns = hold_ns;
+	),
+
+	TP_printk("lcd=%d hold_ns=%llu", __entry->lcd,
+		  (unsigned long long)__entry->hold_ns)
+);
+
+#endif /* _BCM2708_LCD_TRACE_H_ */
+
+/* Ce fichier n'est pas dans include/trace/events : define_trace.h le
+   cherche dans le répertoire du module (voir CFLAGS dans le Makefile) */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bcm2708_lcd_trace
+
+#include <trace/define_trace.h>
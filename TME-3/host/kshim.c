@@ -0,0 +1,943 @@
+/*
+ * kshim: API noyau utilisée par bcm2708_lcd.c, en espace utilisateur.
+ */
+
+#include "kshim.h"
+
+#include <stdarg.h>
+#include <errno.h>
+
+#include "lcd_sim.h"
+
+
+int kshim_verbose;
+
+
+
+// Messages du pilote
+int printk(const char *fmt, ...){
+  va_list ap;
+  int n;
+
+  if(!kshim_verbose)
+    return 0;
+
+  va_start(ap, fmt);
+  n = vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  return n;
+}
+
+
+
+/* Paramètres et chargement du module */
+
+#define KSHIM_PARAM_NR 16
+
+static struct {
+  const char *name;
+  int *values;
+  int size;
+  int *nump;
+} params[KSHIM_PARAM_NR];
+static int params_nr;
+
+
+void kshim_param_register(const char *name, int *values, int size, int *nump){
+  if(params_nr < KSHIM_PARAM_NR){
+    params[params_nr].name = name;
+    params[params_nr].values = values;
+    params[params_nr].size = size;
+    params[params_nr].nump = nump;
+    params_nr++;
+  }
+}
+
+
+// Comme insmod : "value" est une liste de valeurs séparées par des virgules
+int kshim_param_set(const char *name, const char *value){
+  const char *p = value;
+  char *end;
+  int i, n;
+
+  for(i=0;i<params_nr;i++){
+    if(strcmp(params[i].name, name) != 0)
+      continue;
+
+    for(n=0;n<params[i].size;n++){
+      params[i].values[n] = strtol(p, &end, 0);
+      if(end == p)
+        return -1;
+      p = end;
+      if(*p != ',')
+        break;
+      p++;
+    }
+    if(*p != '\0')
+      return -1;
+    if(params[i].nump != NULL)
+      *params[i].nump = n + 1;
+    return 0;
+  }
+
+  return -1;
+}
+
+
+int kshim_module_init(void);
+void kshim_module_exit(void);
+
+int kshim_load(void){
+  return kshim_module_init();
+}
+
+void kshim_unload(void){
+  kshim_module_exit();
+}
+
+
+
+/* Mémoire */
+
+unsigned long get_zeroed_page(int flags){
+  void *p;
+
+  if(posix_memalign(&p, PAGE_SIZE, PAGE_SIZE) != 0)
+    return 0;
+  memset(p, 0, PAGE_SIZE);
+  return (unsigned long)p;
+}
+
+void free_page(unsigned long addr){
+  free((void *)addr);
+}
+
+
+
+/* Attentes */
+
+static void sleep_ns(long long ns){
+  struct timespec ts;
+
+  ts.tv_sec = ns / NSEC_PER_SEC;
+  ts.tv_nsec = ns % NSEC_PER_SEC;
+  while(nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    ;
+}
+
+// udelay() ne dort pas : attente active, comme dans le noyau
+void udelay(unsigned long us){
+  ktime_t end = ktime_get() + (ktime_t)us * NSEC_PER_USEC;
+
+  while(ktime_get() < end)
+    ;
+}
+
+void usleep_range(unsigned long min, unsigned long max){
+  sleep_ns((long long)min * NSEC_PER_USEC);
+}
+
+void msleep(unsigned int ms){
+  sleep_ns((long long)ms * NSEC_PER_MSEC);
+}
+
+
+
+/* Timers haute résolution */
+
+// Thread d'un timer : attend l'échéance, puis appelle la fonction du
+// timer tant qu'elle le réarme
+static void *hrtimer_thread(void *arg){
+  struct hrtimer *timer = arg;
+  enum hrtimer_restart r;
+  struct timespec ts;
+  unsigned int seq;
+
+  pthread_mutex_lock(&timer->m);
+  for(;;){
+    while(!timer->armed && !timer->stop)
+      pthread_cond_wait(&timer->c, &timer->m);
+    if(timer->stop)
+      break;
+
+    ts.tv_sec = timer->expires / NSEC_PER_SEC;
+    ts.tv_nsec = timer->expires % NSEC_PER_SEC;
+    seq = timer->seq;
+    pthread_mutex_unlock(&timer->m);
+
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    r = timer->function(timer);
+
+    // Le timer a pu être réarmé par hrtimer_start() pendant l'appel
+    pthread_mutex_lock(&timer->m);
+    if(r == HRTIMER_NORESTART && seq == timer->seq)
+      timer->armed = 0;
+    pthread_cond_broadcast(&timer->c);
+  }
+  pthread_mutex_unlock(&timer->m);
+
+  return NULL;
+}
+
+
+void hrtimer_init(struct hrtimer *timer, clockid_t clock, enum hrtimer_mode mode){
+  memset(timer, 0, sizeof(*timer));
+  pthread_mutex_init(&timer->m, NULL);
+  pthread_cond_init(&timer->c, NULL);
+}
+
+
+int hrtimer_start(struct hrtimer *timer, ktime_t t, enum hrtimer_mode mode){
+  int err = 0;
+
+  pthread_mutex_lock(&timer->m);
+  timer->expires = mode == HRTIMER_MODE_REL ? ktime_get() + t : t;
+  timer->armed = 1;
+  timer->seq++;
+  if(!timer->started){
+    timer->stop = 0;
+    err = pthread_create(&timer->thread, NULL, hrtimer_thread, timer);
+    timer->started = err == 0;
+  }
+  pthread_cond_broadcast(&timer->c);
+  pthread_mutex_unlock(&timer->m);
+
+  return err ? -ENOMEM : 0;
+}
+
+
+// Arrêt du timer et de son thread : la structure peut ensuite être libérée
+int hrtimer_cancel(struct hrtimer *timer){
+  int armed;
+
+  pthread_mutex_lock(&timer->m);
+  armed = timer->armed;
+  timer->armed = 0;
+  timer->stop = 1;
+  pthread_cond_broadcast(&timer->c);
+  pthread_mutex_unlock(&timer->m);
+
+  if(timer->started){
+    pthread_join(timer->thread, NULL);
+    timer->started = 0;
+  }
+
+  return armed;
+}
+
+
+// Appelée par la fonction du timer : prochaine échéance après maintenant
+u64 hrtimer_forward_now(struct hrtimer *timer, ktime_t interval){
+  ktime_t now = ktime_get();
+  u64 n;
+
+  if(now < timer->expires)
+    return 0;
+
+  n = (now - timer->expires) / interval + 1;
+  timer->expires += n * interval;
+  return n;
+}
+
+
+
+/* File de travaux */
+
+#define KSHIM_WORKERS 4
+
+static pthread_mutex_t wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wq_cond = PTHREAD_COND_INITIALIZER;
+static struct work_struct *wq_head;
+static pthread_once_t wq_once = PTHREAD_ONCE_INIT;
+
+
+// Un travail en attente que personne n'exécute, retiré de la file
+static struct work_struct *wq_take(void){
+  struct work_struct **p;
+  struct work_struct *w;
+
+  for(p=&wq_head;*p!=NULL;p=&(*p)->next){
+    w = *p;
+    if(!w->running){
+      *p = w->next;
+      w->next = NULL;
+      return w;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void *wq_thread(void *arg){
+  struct work_struct *w;
+
+  pthread_mutex_lock(&wq_lock);
+  for(;;){
+    while((w = wq_take()) == NULL)
+      pthread_cond_wait(&wq_cond, &wq_lock);
+
+    w->pending = 0;
+    w->running = 1;
+    pthread_mutex_unlock(&wq_lock);
+
+    w->func(w);
+
+    pthread_mutex_lock(&wq_lock);
+    w->running = 0;
+    pthread_cond_broadcast(&wq_cond);
+  }
+
+  return NULL;
+}
+
+
+static void wq_start(void){
+  pthread_t t;
+  int i;
+
+  for(i=0;i<KSHIM_WORKERS;i++){
+    if(pthread_create(&t, NULL, wq_thread, NULL) == 0)
+      pthread_detach(t);
+  }
+}
+
+
+int schedule_work(struct work_struct *work){
+  struct work_struct **p;
+
+  pthread_once(&wq_once, wq_start);
+
+  pthread_mutex_lock(&wq_lock);
+  if(work->pending){
+    pthread_mutex_unlock(&wq_lock);
+    return 0;
+  }
+
+  work->pending = 1;
+  for(p=&wq_head;*p!=NULL;p=&(*p)->next)
+    ;
+  *p = work;
+  pthread_cond_broadcast(&wq_cond);
+  pthread_mutex_unlock(&wq_lock);
+
+  return 1;
+}
+
+
+int flush_work(struct work_struct *work){
+  int waited = 0;
+
+  pthread_mutex_lock(&wq_lock);
+  while(work->pending || work->running){
+    pthread_cond_wait(&wq_cond, &wq_lock);
+    waited = 1;
+  }
+  pthread_mutex_unlock(&wq_lock);
+
+  return waited;
+}
+
+
+int cancel_work_sync(struct work_struct *work){
+  struct work_struct **p;
+  int pending;
+
+  pthread_mutex_lock(&wq_lock);
+  pending = work->pending;
+  if(pending){
+    for(p=&wq_head;*p!=work;p=&(*p)->next)
+      ;
+    *p = work->next;
+    work->next = NULL;
+    work->pending = 0;
+  }
+  while(work->running)
+    pthread_cond_wait(&wq_cond, &wq_lock);
+  pthread_mutex_unlock(&wq_lock);
+
+  return pending;
+}
+
+
+
+/* kfifo */
+
+// Copie de "n" éléments vers ou depuis la file, à partir de l'indice
+// libre "off", en deux morceaux si la fin du tampon est atteinte
+unsigned int kshim_kfifo_copy(void *fifo, unsigned int size, unsigned int esize,
+                              unsigned int off, void *data, unsigned int n,
+                              int to_fifo){
+  unsigned int first;
+
+  off &= size - 1;
+  first = min(n, size - off);
+
+  if(to_fifo){
+    memcpy((char *)fifo + off * esize, data, first * esize);
+    memcpy(fifo, (char *)data + first * esize, (n - first) * esize);
+  }
+  else{
+    memcpy(data, (char *)fifo + off * esize, first * esize);
+    memcpy((char *)data + first * esize, fifo, (n - first) * esize);
+  }
+
+  return n;
+}
+
+
+
+/* Périphériques caractère */
+
+#define KSHIM_MAJOR 240
+#define KSHIM_MINOR_NR 16
+
+static pthread_mutex_t cdev_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cdev *cdevs[KSHIM_MINOR_NR];
+
+
+int alloc_chrdev_region(dev_t *dev, unsigned int first, unsigned int count,
+                        const char *name){
+  if(first + count > KSHIM_MINOR_NR)
+    return -EBUSY;
+
+  *dev = MKDEV(KSHIM_MAJOR, first);
+  return 0;
+}
+
+void unregister_chrdev_region(dev_t first, unsigned int count){
+}
+
+
+void cdev_init(struct cdev *cdev, const struct file_operations *fops){
+  memset(cdev, 0, sizeof(*cdev));
+  cdev->ops = fops;
+}
+
+
+int cdev_add(struct cdev *cdev, dev_t dev, unsigned int count){
+  unsigned int i;
+
+  if(MINOR(dev) + count > KSHIM_MINOR_NR)
+    return -EINVAL;
+
+  cdev->dev = dev;
+  cdev->count = count;
+
+  pthread_mutex_lock(&cdev_lock);
+  for(i=0;i<count;i++)
+    cdevs[MINOR(dev) + i] = cdev;
+  pthread_mutex_unlock(&cdev_lock);
+
+  return 0;
+}
+
+
+void cdev_del(struct cdev *cdev){
+  unsigned int i;
+
+  pthread_mutex_lock(&cdev_lock);
+  for(i=0;i<cdev->count;i++)
+    cdevs[MINOR(cdev->dev) + i] = NULL;
+  pthread_mutex_unlock(&cdev_lock);
+}
+
+
+
+// Un fichier ouvert, avec l'inode qui l'a ouvert
+struct kshim_file {
+  struct file file;
+  struct inode inode;
+};
+
+
+struct file *kshim_open(unsigned int minor, unsigned int flags){
+  struct kshim_file *f;
+  struct cdev *cdev = NULL;
+  int err;
+
+  pthread_mutex_lock(&cdev_lock);
+  if(minor < KSHIM_MINOR_NR)
+    cdev = cdevs[minor];
+  pthread_mutex_unlock(&cdev_lock);
+
+  if(cdev == NULL){
+    errno = ENODEV;
+    return NULL;
+  }
+
+  f = calloc(1, sizeof(*f));
+  if(f == NULL)
+    return NULL;
+
+  f->inode.i_cdev = cdev;
+  f->inode.i_rdev = MKDEV(MAJOR(cdev->dev), minor);
+  f->file.f_op = cdev->ops;
+  f->file.f_flags = flags;
+
+  if(f->file.f_op->open != NULL){
+    err = f->file.f_op->open(&f->inode, &f->file);
+    if(err < 0){
+      free(f);
+      errno = -err;
+      return NULL;
+    }
+  }
+
+  return &f->file;
+}
+
+
+int kshim_close(struct file *filp){
+  struct kshim_file *f = container_of(filp, struct kshim_file, file);
+  int err = 0;
+
+  if(filp->f_op->release != NULL)
+    err = filp->f_op->release(&f->inode, filp);
+  free(f);
+  return err;
+}
+
+
+ssize_t kshim_write(struct file *filp, const void *buf, size_t len){
+  return filp->f_op->write(filp, buf, len, &filp->f_pos);
+}
+
+
+long kshim_ioctl(struct file *filp, unsigned int cmd, unsigned long arg){
+  return filp->f_op->unlocked_ioctl(filp, cmd, arg);
+}
+
+
+int kshim_fsync(struct file *filp){
+  return filp->f_op->fsync(filp, 0, LLONG_MAX, 0);
+}
+
+
+unsigned int kshim_poll(struct file *filp){
+  return filp->f_op->poll(filp, NULL);
+}
+
+
+
+/* debugfs */
+
+struct dentry {
+  char name[32];
+  struct dentry *parent;
+  const struct file_operations *fops;   // NULL pour un répertoire
+  void *data;
+  struct dentry *next;
+};
+
+static pthread_mutex_t debugfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dentry *debugfs_nodes;
+
+
+static struct dentry *debugfs_create(const char *name, struct dentry *parent,
+                                     void *data,
+                                     const struct file_operations *fops){
+  struct dentry *d;
+
+  d = calloc(1, sizeof(*d));
+  if(d == NULL)
+    return NULL;
+
+  snprintf(d->name, sizeof(d->name), "%s", name);
+  d->parent = parent;
+  d->fops = fops;
+  d->data = data;
+
+  pthread_mutex_lock(&debugfs_lock);
+  d->next = debugfs_nodes;
+  debugfs_nodes = d;
+  pthread_mutex_unlock(&debugfs_lock);
+
+  return d;
+}
+
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent){
+  return debugfs_create(name, parent, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, unsigned short mode,
+                                   struct dentry *parent, void *data,
+                                   const struct file_operations *fops){
+  return debugfs_create(name, parent, data, fops);
+}
+
+
+static int debugfs_under(const struct dentry *d, const struct dentry *top){
+  for(;d!=NULL;d=d->parent){
+    if(d == top)
+      return 1;
+  }
+  return 0;
+}
+
+void debugfs_remove_recursive(struct dentry *dentry){
+  struct dentry **p, *d, *dead = NULL;
+
+  if(dentry == NULL)
+    return;
+
+  // On détache d'abord tout le sous-arbre : les parents sont libérés
+  // après que leurs enfants ont été reconnus
+  pthread_mutex_lock(&debugfs_lock);
+  for(p=&debugfs_nodes;*p!=NULL;){
+    d = *p;
+    if(debugfs_under(d, dentry)){
+      *p = d->next;
+      d->next = dead;
+      dead = d;
+    }
+    else
+      p = &d->next;
+  }
+  pthread_mutex_unlock(&debugfs_lock);
+
+  while(dead != NULL){
+    d = dead;
+    dead = d->next;
+    free(d);
+  }
+}
+
+
+// Nœud "name" de parent "parent"
+static struct dentry *debugfs_lookup(const char *name, size_t len,
+                                     struct dentry *parent){
+  struct dentry *d;
+
+  for(d=debugfs_nodes;d!=NULL;d=d->next){
+    if(d->parent == parent && strlen(d->name) == len &&
+       strncmp(d->name, name, len) == 0)
+      return d;
+  }
+  return NULL;
+}
+
+
+ssize_t kshim_debugfs_read(const char *path, char *buf, size_t size){
+  struct dentry *d = NULL;
+  struct inode inode;
+  struct file file;
+  const char *p = path;
+  size_t len, done = 0;
+  ssize_t n;
+  loff_t pos = 0;
+
+  if(size == 0)
+    return -1;
+
+  pthread_mutex_lock(&debugfs_lock);
+  for(;;){
+    len = strcspn(p, "/");
+    d = debugfs_lookup(p, len, d);
+    if(d == NULL || p[len] == '\0')
+      break;
+    p += len + 1;
+  }
+  pthread_mutex_unlock(&debugfs_lock);
+
+  if(d == NULL || d->fops == NULL)
+    return -1;
+
+  memset(&inode, 0, sizeof(inode));
+  memset(&file, 0, sizeof(file));
+  inode.i_private = d->data;
+  file.f_op = d->fops;
+
+  if(d->fops->open(&inode, &file) < 0)
+    return -1;
+
+  while(done < size - 1){
+    n = d->fops->read(&file, buf + done, size - 1 - done, &pos);
+    if(n <= 0)
+      break;
+    done += n;
+  }
+  buf[done] = '\0';
+
+  d->fops->release(&inode, &file);
+  return done;
+}
+
+
+
+/* seq_file, pour single_open() seulement */
+
+int seq_printf(struct seq_file *m, const char *fmt, ...){
+  va_list ap;
+  char *buf;
+  int n;
+
+  for(;;){
+    va_start(ap, fmt);
+    n = vsnprintf(m->buf + m->count, m->size - m->count, fmt, ap);
+    va_end(ap);
+
+    if(n < 0)
+      return -1;
+    if((size_t)n < m->size - m->count){
+      m->count += n;
+      return 0;
+    }
+
+    buf = realloc(m->buf, 2 * m->size + n);
+    if(buf == NULL)
+      return -1;
+    m->buf = buf;
+    m->size = 2 * m->size + n;
+  }
+}
+
+
+int single_open(struct file *filp, int (*show)(struct seq_file *, void *),
+                void *data){
+  struct seq_file *m;
+
+  m = calloc(1, sizeof(*m));
+  if(m == NULL)
+    return -ENOMEM;
+
+  m->size = 256;
+  m->buf = malloc(m->size);
+  if(m->buf == NULL){
+    free(m);
+    return -ENOMEM;
+  }
+
+  m->show = show;
+  m->private = data;
+  filp->private_data = m;
+  return 0;
+}
+
+
+int single_release(struct inode *inode, struct file *filp){
+  struct seq_file *m = filp->private_data;
+
+  free(m->buf);
+  free(m);
+  return 0;
+}
+
+
+// Le texte est produit à la première lecture
+ssize_t seq_read(struct file *filp, char *buf, size_t size, loff_t *ppos){
+  struct seq_file *m = filp->private_data;
+  size_t n;
+
+  if(*ppos == 0){
+    m->count = 0;
+    if(m->show(m, m->private) < 0)
+      return -EIO;
+  }
+
+  if((size_t)*ppos >= m->count)
+    return 0;
+
+  n = min(size, m->count - (size_t)*ppos);
+  memcpy(buf, m->buf + *ppos, n);
+  *ppos += n;
+  return n;
+}
+
+
+loff_t seq_lseek(struct file *filp, loff_t off, int whence){
+  return -ESPIPE;
+}
+
+
+
+/* GPIO */
+
+#define GPIO_REG_SET0 0x1c
+#define GPIO_REG_CLR0 0x28
+
+static pthread_mutex_t gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lcd_sim *sims[KSHIM_SIM_NR];
+static int sims_nr;
+static unsigned long long requested;
+static u32 gpio_regs[SZ_4K / sizeof(u32)];
+
+
+int kshim_gpio_attach(struct lcd_sim *sim){
+  int err = -1;
+
+  pthread_mutex_lock(&gpio_lock);
+  if(sims_nr < KSHIM_SIM_NR){
+    sims[sims_nr++] = sim;
+    err = 0;
+  }
+  pthread_mutex_unlock(&gpio_lock);
+
+  return err;
+}
+
+void kshim_gpio_detach_all(void){
+  pthread_mutex_lock(&gpio_lock);
+  sims_nr = 0;
+  pthread_mutex_unlock(&gpio_lock);
+}
+
+
+// Écriture de GPSET0 puis de GPCLR0 : tous les bancs simulés voient les
+// mêmes niveaux, chacun ne lit que ses broches
+static void gpio_update(u32 set, u32 clear){
+  int i;
+
+  pthread_mutex_lock(&gpio_lock);
+  for(i=0;i<sims_nr;i++)
+    lcd_sim_update_mask(sims[i], set, clear);
+  pthread_mutex_unlock(&gpio_lock);
+}
+
+
+int gpio_request_array(const struct gpio *array, size_t num){
+  unsigned long long mask = 0;
+  size_t i;
+
+  for(i=0;i<num;i++){
+    if(!gpio_is_valid(array[i].gpio) || (mask & (1ULL << array[i].gpio)))
+      return -EINVAL;
+    mask |= 1ULL << array[i].gpio;
+  }
+
+  pthread_mutex_lock(&gpio_lock);
+  if(requested & mask){
+    pthread_mutex_unlock(&gpio_lock);
+    return -EBUSY;
+  }
+  requested |= mask;
+  pthread_mutex_unlock(&gpio_lock);
+
+  for(i=0;i<num;i++){
+    if(!(array[i].flags & GPIOF_DIR_IN))
+      gpio_set_value(array[i].gpio, (array[i].flags & GPIOF_INIT_HIGH) != 0);
+  }
+
+  return 0;
+}
+
+
+void gpio_free_array(const struct gpio *array, size_t num){
+  size_t i;
+
+  pthread_mutex_lock(&gpio_lock);
+  for(i=0;i<num;i++)
+    requested &= ~(1ULL << array[i].gpio);
+  pthread_mutex_unlock(&gpio_lock);
+}
+
+
+void gpio_set_value(unsigned int gpio, int value){
+  if(gpio >= 32)
+    return;
+
+  if(value)
+    gpio_update(1u << gpio, 0);
+  else
+    gpio_update(0, 1u << gpio);
+}
+
+
+int gpio_get_value(unsigned int gpio){
+  int v = 0;
+
+  pthread_mutex_lock(&gpio_lock);
+  if(sims_nr > 0 && gpio < 32)
+    v = (sims[0]->level >> gpio) & 0x1;
+  pthread_mutex_unlock(&gpio_lock);
+
+  return v;
+}
+
+
+// Descripteurs : le descripteur de la broche "n" est la case "n"
+struct gpio_desc {
+  unsigned int gpio;
+};
+
+static struct gpio_desc gpio_descs[KSHIM_GPIO_NR];
+
+
+struct gpio_desc *gpio_to_desc(unsigned int gpio){
+  if(!gpio_is_valid(gpio))
+    return NULL;
+
+  gpio_descs[gpio].gpio = gpio;
+  return &gpio_descs[gpio];
+}
+
+
+void gpiod_set_value(struct gpio_desc *desc, int value){
+  gpio_set_value(desc->gpio, value);
+}
+
+
+// Un seul appel à gpio_update() : les lignes changent ensemble
+static void gpiod_update(unsigned int n, struct gpio_desc **descs,
+                         unsigned long long values){
+  u32 set = 0, clear = 0;
+  unsigned int i;
+
+  for(i=0;i<n;i++){
+    if(descs[i]->gpio >= 32)
+      continue;
+    if((values >> i) & 0x1)
+      set |= 1u << descs[i]->gpio;
+    else
+      clear |= 1u << descs[i]->gpio;
+  }
+
+  gpio_update(set, clear);
+}
+
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+int gpiod_set_array_value(unsigned int array_size, struct gpio_desc **desc_array,
+                          struct gpio_array *array_info, unsigned long *value_bitmap){
+  gpiod_update(array_size, desc_array, value_bitmap[0]);
+  return 0;
+}
+#else
+void gpiod_set_array_value(unsigned int array_size, struct gpio_desc **desc_array,
+                           int *value_array){
+  unsigned long long values = 0;
+  unsigned int i;
+
+  for(i=0;i<array_size;i++)
+    values |= (unsigned long long)(value_array[i] != 0) << i;
+  gpiod_update(array_size, desc_array, values);
+}
+#endif
+
+
+void __iomem *ioremap(unsigned long phys, unsigned long size){
+  if(phys != GPIO_BASE || size > sizeof(gpio_regs))
+    return NULL;
+  return gpio_regs;
+}
+
+void iounmap(volatile void __iomem *addr){
+}
+
+
+void writel(u32 value, volatile void __iomem *addr){
+  unsigned long off = (unsigned long)addr - (unsigned long)gpio_regs;
+
+  switch(off){
+  case GPIO_REG_SET0: gpio_update(value, 0); break;
+  case GPIO_REG_CLR0: gpio_update(0, value); break;
+  default:            gpio_regs[off / sizeof(u32)] = value; break;
+  }
+}
+
+
+u32 readl(const volatile void __iomem *addr){
+  return *(const volatile u32 *)addr;
+}
@@ -0,0 +1,702 @@
+#ifndef _KSHIM_H_
+#define _KSHIM_H_
+
+/*
+ * kshim: the kernel API used by bcm2708_lcd.c, in user space.
+ *
+ * The headers of host/linux, host/asm, host/mach and host/trace all
+ * include this file, so the driver source builds unchanged on the host
+ * (see "make host"). Locks are POSIX mutexes, the hrtimer and the
+ * workqueue are threads, and the GPIO registers are routed to the
+ * simulated HD44780 controllers of liblcd (lcd_sim).
+ *
+ * The functions prefixed with kshim_ drive the "kernel" from a test
+ * program: module parameters and loading, opening the device files,
+ * and reading the debugfs files.
+ */
+
+#include <linux/types.h>
+#include <linux/errno.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+struct lcd_sim;
+
+
+/* Types and compiler annotations */
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t  s32;
+typedef long long s64;
+
+#define __init
+#define __exit
+#define __user
+#define __iomem
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define container_of(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(a, b)        ((a) < (b) ? (a) : (b))
+#define max(a, b)        ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)   ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)   ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define swap(a, b) \
+  do { __typeof__(a) __t = (a); (a) = (b); (b) = __t; } while (0)
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+/* The kernel of the lab board by default: the register path of the
+   driver. "make host HOST_KERNEL=4,19,0" (or 4,20,0, 5,0,0) builds its
+   descriptor path instead; both are routed to the simulator. */
+#ifndef LINUX_VERSION_CODE
+#define LINUX_VERSION_CODE KERNEL_VERSION(3, 11, 10)
+#endif
+
+#define ERESTARTSYS 512
+
+
+/* Modules and parameters */
+
+#define THIS_MODULE NULL
+struct module;
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 12, 0)
+#define MODULE_SUPPORTED_DEVICE(x)
+#endif
+#define MODULE_LICENSE(x)
+#define MODULE_PARM_DESC(name, desc)
+
+void kshim_param_register ( const char *name, int *values, int size,
+                            int *nump );
+
+#define module_param_array(name, type, nump, perm)                     \
+  static void __attribute__((constructor)) kshim_param_##name ( void ) \
+  { kshim_param_register ( #name, name, ARRAY_SIZE(name), nump ); }
+
+#define module_param(name, type, perm)                                 \
+  static void __attribute__((constructor)) kshim_param_##name ( void ) \
+  { kshim_param_register ( #name, &name, 1, NULL ); }
+
+#define module_init(fn) int  kshim_module_init ( void ) { return fn (); }
+#define module_exit(fn) void kshim_module_exit ( void ) { fn (); }
+
+/*
+ * Set the integer parameter (or array) 'name' from a comma-separated
+ * list, as insmod would. Return -1 if there is no such parameter.
+ */
+
+int
+kshim_param_set ( const char *name, const char *value );
+
+/*
+ * Load and unload the module: run its module_init and module_exit
+ * functions. kshim_load returns the error of module_init.
+ */
+
+int
+kshim_load ( void );
+
+void
+kshim_unload ( void );
+
+
+/* printk: silent unless kshim_verbose is set */
+
+#define KERN_ALERT   ""
+#define KERN_ERR     ""
+#define KERN_WARNING ""
+#define KERN_INFO    ""
+#define KERN_DEBUG   ""
+
+extern int kshim_verbose;
+
+int printk ( const char *fmt, ... ) __attribute__((format(printf, 1, 2)));
+
+
+/* Memory */
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+
+#define PAGE_SIZE  4096UL
+#define PAGE_SHIFT 12
+
+static inline void *kmalloc ( size_t size, int flags )  { return malloc ( size ); }
+static inline void *kzalloc ( size_t size, int flags )  { return calloc ( 1, size ); }
+static inline void  kfree ( const void *p )             { free ( ( void * ) p ); }
+
+unsigned long get_zeroed_page ( int flags );
+void free_page ( unsigned long addr );
+
+struct page;
+static inline struct page *virt_to_page ( const void *p ) { return ( struct page * ) p; }
+static inline unsigned long virt_to_phys ( const volatile void *p ) { return ( unsigned long ) p; }
+static inline void SetPageReserved ( struct page *p )   { }
+static inline void ClearPageReserved ( struct page *p ) { }
+
+/* mmap: there is no user address space to map the page into */
+struct vm_area_struct {
+  unsigned long vm_start, vm_end, vm_pgoff, vm_flags;
+  unsigned long vm_page_prot;
+};
+
+#define VM_SHARED 0x8
+
+static inline int remap_pfn_range ( struct vm_area_struct *vma,
+                                    unsigned long addr, unsigned long pfn,
+                                    unsigned long size, unsigned long prot )
+{
+  return -ENOSYS;
+}
+
+
+/* User memory: the "user" buffers of the test program are plain memory */
+
+#define VERIFY_READ  0
+#define VERIFY_WRITE 1
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0)
+#define access_ok(addr, size) ( ( void ) ( addr ), 1 )
+#else
+#define access_ok(type, addr, size) ( ( void ) ( addr ), 1 )
+#endif
+
+static inline unsigned long copy_from_user ( void *to, const void *from,
+                                             unsigned long n )
+{
+  memcpy ( to, from, n );
+  return 0;
+}
+
+static inline unsigned long copy_to_user ( void *to, const void *from,
+                                           unsigned long n )
+{
+  memcpy ( to, from, n );
+  return 0;
+}
+
+#define get_user(x, p)   ( ( x ) = *( p ), 0 )
+#define put_user(x, p)   ( *( p ) = ( x ), 0 )
+#define __get_user(x, p) get_user ( x, p )
+#define __put_user(x, p) put_user ( x, p )
+
+
+/* Atomic bit operations */
+
+#define BITS_PER_LONG           ( 8 * sizeof ( long ) )
+#define BITS_TO_LONGS(n)        ( ( ( n ) + BITS_PER_LONG - 1 ) / BITS_PER_LONG )
+#define DECLARE_BITMAP(name, n) unsigned long name[BITS_TO_LONGS(n)]
+
+static inline void set_bit ( int nr, volatile unsigned long *addr )
+{
+  __atomic_fetch_or ( addr + nr / BITS_PER_LONG, 1UL << ( nr % BITS_PER_LONG ),
+                      __ATOMIC_SEQ_CST );
+}
+
+static inline void clear_bit ( int nr, volatile unsigned long *addr )
+{
+  __atomic_fetch_and ( addr + nr / BITS_PER_LONG, ~( 1UL << ( nr % BITS_PER_LONG ) ),
+                       __ATOMIC_SEQ_CST );
+}
+
+static inline int test_bit ( int nr, const volatile unsigned long *addr )
+{
+  return ( addr[nr / BITS_PER_LONG] >> ( nr % BITS_PER_LONG ) ) & 1;
+}
+
+#define xchg(p, v) __atomic_exchange_n ( ( p ), ( v ), __ATOMIC_SEQ_CST )
+
+
+/* Lists */
+
+struct list_head {
+  struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD ( struct list_head *l )
+{
+  l->next = l;
+  l->prev = l;
+}
+
+static inline void list_add_tail ( struct list_head *n, struct list_head *head )
+{
+  n->prev = head->prev;
+  n->next = head;
+  head->prev->next = n;
+  head->prev = n;
+}
+
+static inline void list_add ( struct list_head *n, struct list_head *head )
+{
+  list_add_tail ( n, head->next );
+}
+
+static inline void list_del ( struct list_head *e )
+{
+  e->prev->next = e->next;
+  e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
+
+static inline int list_empty ( const struct list_head *head )
+{
+  return head->next == head;
+}
+
+#define list_entry(p, type, member) container_of ( p, type, member )
+
+#define list_for_each_entry(pos, head, member)                           \
+  for ( pos = list_entry ( ( head )->next, __typeof__ ( *pos ), member );  \
+        &pos->member != ( head );                                        \
+        pos = list_entry ( pos->member.next, __typeof__ ( *pos ), member ) )
+
+
+/* Locks */
+
+typedef struct {
+  pthread_mutex_t m;
+} spinlock_t;
+
+static inline void spin_lock_init ( spinlock_t *l ) { pthread_mutex_init ( &l->m, NULL ); }
+static inline void spin_lock ( spinlock_t *l )      { pthread_mutex_lock ( &l->m ); }
+static inline void spin_unlock ( spinlock_t *l )    { pthread_mutex_unlock ( &l->m ); }
+
+#define spin_lock_irqsave(l, flags)      ( ( flags ) = 0, spin_lock ( l ) )
+#define spin_unlock_irqrestore(l, flags) ( ( void ) ( flags ), spin_unlock ( l ) )
+#define spin_lock_bh(l)                  spin_lock ( l )
+#define spin_unlock_bh(l)                spin_unlock ( l )
+
+struct mutex {
+  pthread_mutex_t m;
+};
+
+static inline void mutex_init ( struct mutex *l )   { pthread_mutex_init ( &l->m, NULL ); }
+static inline void mutex_lock ( struct mutex *l )   { pthread_mutex_lock ( &l->m ); }
+static inline void mutex_unlock ( struct mutex *l ) { pthread_mutex_unlock ( &l->m ); }
+static inline int  mutex_lock_interruptible ( struct mutex *l )
+{
+  pthread_mutex_lock ( &l->m );
+  return 0;
+}
+
+
+/* Wait queues and completions. Nothing interrupts a wait on the host. */
+
+typedef struct {
+  pthread_mutex_t m;
+  pthread_cond_t  c;
+} wait_queue_head_t;
+
+static inline void init_waitqueue_head ( wait_queue_head_t *q )
+{
+  pthread_mutex_init ( &q->m, NULL );
+  pthread_cond_init ( &q->c, NULL );
+}
+
+static inline void wake_up ( wait_queue_head_t *q )
+{
+  pthread_mutex_lock ( &q->m );
+  pthread_cond_broadcast ( &q->c );
+  pthread_mutex_unlock ( &q->m );
+}
+
+#define wake_up_interruptible(q) wake_up ( q )
+
+#define wait_event(q, cond)                                 \
+  do {                                                      \
+    pthread_mutex_lock ( &( q ).m );                        \
+    while ( !( cond ) ) {                                   \
+      pthread_cond_wait ( &( q ).c, &( q ).m );             \
+    }                                                       \
+    pthread_mutex_unlock ( &( q ).m );                      \
+  } while ( 0 )
+
+#define wait_event_interruptible(q, cond) ( { wait_event ( q, cond ); 0; } )
+
+struct completion {
+  pthread_mutex_t m;
+  pthread_cond_t  c;
+  unsigned int    done;
+};
+
+static inline void init_completion ( struct completion *x )
+{
+  pthread_mutex_init ( &x->m, NULL );
+  pthread_cond_init ( &x->c, NULL );
+  x->done = 0;
+}
+
+static inline void complete ( struct completion *x )
+{
+  pthread_mutex_lock ( &x->m );
+  x->done++;
+  pthread_cond_broadcast ( &x->c );
+  pthread_mutex_unlock ( &x->m );
+}
+
+static inline void wait_for_completion ( struct completion *x )
+{
+  pthread_mutex_lock ( &x->m );
+  while ( x->done == 0 ) {
+    pthread_cond_wait ( &x->c, &x->m );
+  }
+  x->done--;
+  pthread_mutex_unlock ( &x->m );
+}
+
+
+/* Time */
+
+typedef s64 ktime_t;
+
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC  1000000000L
+
+static inline ktime_t ktime_get ( void )
+{
+  struct timespec ts;
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+  return ( ktime_t ) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+#define ktime_set(s, ns)   ( ( ktime_t ) ( s ) * NSEC_PER_SEC + ( ns ) )
+#define ns_to_ktime(ns)    ( ( ktime_t ) ( ns ) )
+#define ktime_to_ns(k)     ( ( s64 ) ( k ) )
+#define ktime_sub(a, b)    ( ( a ) - ( b ) )
+#define ktime_add(a, b)    ( ( a ) + ( b ) )
+#define ktime_add_ns(k, n) ( ( k ) + ( n ) )
+
+void udelay ( unsigned long us );
+void usleep_range ( unsigned long min, unsigned long max );
+void msleep ( unsigned int ms );
+
+#define ndelay(ns) udelay ( ( ( ns ) + 999 ) / 1000 )
+#define mdelay(ms) udelay ( ( ms ) * 1000UL )
+
+
+/*
+ * High-resolution timers: one thread per armed timer, which sleeps until
+ * the expiry and runs the callback, as often as the callback restarts
+ * the timer.
+ */
+
+enum hrtimer_restart { HRTIMER_NORESTART, HRTIMER_RESTART };
+enum hrtimer_mode    { HRTIMER_MODE_ABS, HRTIMER_MODE_REL };
+
+struct hrtimer {
+  enum hrtimer_restart ( *function ) ( struct hrtimer * );
+  ktime_t         expires;
+  pthread_t       thread;
+  pthread_mutex_t m;
+  pthread_cond_t  c;
+  int             started;   /* the thread exists */
+  int             armed;
+  unsigned int    seq;       /* number of hrtimer_start() calls */
+  int             stop;
+};
+
+void hrtimer_init ( struct hrtimer *timer, clockid_t clock, enum hrtimer_mode mode );
+int  hrtimer_start ( struct hrtimer *timer, ktime_t t, enum hrtimer_mode mode );
+int  hrtimer_cancel ( struct hrtimer *timer );
+u64  hrtimer_forward_now ( struct hrtimer *timer, ktime_t interval );
+
+static inline void hrtimer_set_expires ( struct hrtimer *timer, ktime_t time )
+{
+  timer->expires = time;
+}
+
+
+/*
+ * Workqueue: a pool of threads runs the scheduled works. As in the
+ * kernel, a work is never run by two threads at once.
+ */
+
+struct work_struct {
+  void ( *func ) ( struct work_struct * );
+  struct work_struct *next;
+  int pending;
+  int running;
+};
+
+#define INIT_WORK(w, f)                 \
+  do {                                  \
+    ( w )->func = ( f );                \
+    ( w )->next = NULL;                 \
+    ( w )->pending = 0;                 \
+    ( w )->running = 0;                 \
+  } while ( 0 )
+
+int schedule_work ( struct work_struct *work );
+int flush_work ( struct work_struct *work );
+int cancel_work_sync ( struct work_struct *work );
+
+
+/*
+ * kfifo: lock-free with a single reader and a single writer, like the
+ * kernel one. The size is a power of 2.
+ */
+
+#define DECLARE_KFIFO(name, type, size) \
+  struct {                              \
+    unsigned int in, out;               \
+    type buf[size];                     \
+  } name
+
+#define INIT_KFIFO(f) ( ( f ).in = ( f ).out = 0 )
+
+#define __kfifo_size(f) ( ARRAY_SIZE ( ( f )->buf ) )
+#define __kfifo_in(f)   __atomic_load_n ( &( f )->in, __ATOMIC_ACQUIRE )
+#define __kfifo_out(f)  __atomic_load_n ( &( f )->out, __ATOMIC_ACQUIRE )
+
+#define kfifo_len(f)      ( __kfifo_in ( f ) - __kfifo_out ( f ) )
+#define kfifo_is_empty(f) ( kfifo_len ( f ) == 0 )
+#define kfifo_is_full(f)  ( kfifo_len ( f ) == __kfifo_size ( f ) )
+#define kfifo_avail(f)    ( __kfifo_size ( f ) - kfifo_len ( f ) )
+
+#define kfifo_reset_out(f) \
+  __atomic_store_n ( &( f )->out, __kfifo_in ( f ), __ATOMIC_RELEASE )
+
+unsigned int kshim_kfifo_copy ( void *fifo, unsigned int size, unsigned int esize,
+                                unsigned int off, void *data, unsigned int n,
+                                int to_fifo );
+
+#define kfifo_in(f, from, n)                                                  \
+  ( {                                                                         \
+    unsigned int __n = min_t ( unsigned int, n, kfifo_avail ( f ) );          \
+    kshim_kfifo_copy ( ( f )->buf, __kfifo_size ( f ), sizeof ( ( f )->buf[0] ), \
+                       ( f )->in, ( void * ) ( from ), __n, 1 );              \
+    __atomic_store_n ( &( f )->in, ( f )->in + __n, __ATOMIC_RELEASE );       \
+    __n;                                                                      \
+  } )
+
+#define kfifo_out(f, to, n)                                                   \
+  ( {                                                                         \
+    unsigned int __n = min_t ( unsigned int, n, kfifo_len ( f ) );            \
+    kshim_kfifo_copy ( ( f )->buf, __kfifo_size ( f ), sizeof ( ( f )->buf[0] ), \
+                       ( f )->out, ( to ), __n, 0 );                          \
+    __atomic_store_n ( &( f )->out, ( f )->out + __n, __ATOMIC_RELEASE );     \
+    __n;                                                                      \
+  } )
+
+#define kfifo_from_user(f, from, n, copied) \
+  ( *( copied ) = kfifo_in ( f, from, n ), 0 )
+
+
+/* Files and character devices */
+
+struct file_operations;
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+
+struct cdev {
+  struct module *owner;
+  const struct file_operations *ops;
+  dev_t dev;
+  unsigned int count;
+};
+
+struct inode {
+  struct cdev *i_cdev;
+  dev_t        i_rdev;
+  void        *i_private;
+};
+
+struct file {
+  const struct file_operations *f_op;
+  unsigned int f_flags;
+  loff_t       f_pos;
+  void        *private_data;
+};
+
+struct file_operations {
+  struct module *owner;
+  loff_t       ( *llseek ) ( struct file *, loff_t, int );
+  ssize_t      ( *read ) ( struct file *, char *, size_t, loff_t * );
+  ssize_t      ( *write ) ( struct file *, const char *, size_t, loff_t * );
+  unsigned int ( *poll ) ( struct file *, poll_table * );
+  long         ( *unlocked_ioctl ) ( struct file *, unsigned int, unsigned long );
+  int          ( *mmap ) ( struct file *, struct vm_area_struct * );
+  int          ( *open ) ( struct inode *, struct file * );
+  int          ( *release ) ( struct inode *, struct file * );
+  int          ( *fsync ) ( struct file *, loff_t, loff_t, int );
+};
+
+#define MINORBITS  20
+#define MINORMASK  ( ( 1U << MINORBITS ) - 1 )
+#define MAJOR(dev) ( ( unsigned int ) ( ( dev ) >> MINORBITS ) )
+#define MINOR(dev) ( ( unsigned int ) ( ( dev ) & MINORMASK ) )
+#define MKDEV(ma, mi) ( ( ( ma ) << MINORBITS ) | ( mi ) )
+
+int  alloc_chrdev_region ( dev_t *dev, unsigned int first, unsigned int count,
+                           const char *name );
+void unregister_chrdev_region ( dev_t first, unsigned int count );
+void cdev_init ( struct cdev *cdev, const struct file_operations *fops );
+int  cdev_add ( struct cdev *cdev, dev_t dev, unsigned int count );
+void cdev_del ( struct cdev *cdev );
+
+static inline void poll_wait ( struct file *filp, wait_queue_head_t *q, poll_table *p ) { }
+
+#ifndef POLLIN
+#define POLLIN     0x0001
+#define POLLOUT    0x0004
+#define POLLRDNORM 0x0040
+#define POLLWRNORM 0x0100
+#endif
+
+/*
+ * Open the device file of minor number 'minor' with the given O_ flags
+ * and call its operations. The return values are those of the driver
+ * (negative errno values); kshim_open returns NULL on error.
+ */
+
+struct file *
+kshim_open ( unsigned int minor, unsigned int flags );
+
+int
+kshim_close ( struct file *filp );
+
+ssize_t
+kshim_write ( struct file *filp, const void *buf, size_t len );
+
+long
+kshim_ioctl ( struct file *filp, unsigned int cmd, unsigned long arg );
+
+int
+kshim_fsync ( struct file *filp );
+
+unsigned int
+kshim_poll ( struct file *filp );
+
+
+/* debugfs and seq_file */
+
+struct dentry;
+
+struct seq_file {
+  char   *buf;
+  size_t  size;
+  size_t  count;
+  int   ( *show ) ( struct seq_file *, void * );
+  void   *private;
+};
+
+struct dentry *debugfs_create_dir ( const char *name, struct dentry *parent );
+struct dentry *debugfs_create_file ( const char *name, unsigned short mode,
+                                     struct dentry *parent, void *data,
+                                     const struct file_operations *fops );
+void debugfs_remove_recursive ( struct dentry *dentry );
+
+int     seq_printf ( struct seq_file *m, const char *fmt, ... )
+          __attribute__((format(printf, 2, 3)));
+int     single_open ( struct file *filp, int ( *show ) ( struct seq_file *, void * ),
+                      void *data );
+int     single_release ( struct inode *inode, struct file *filp );
+ssize_t seq_read ( struct file *filp, char *buf, size_t size, loff_t *ppos );
+loff_t  seq_lseek ( struct file *filp, loff_t off, int whence );
+
+/*
+ * Read the debugfs file 'path' (e.g. "bcm2708_lcd/lcd0/stats") into
+ * 'buf', null-terminated. Return the length, or -1 if there is no such
+ * file.
+ */
+
+ssize_t
+kshim_debugfs_read ( const char *path, char *buf, size_t size );
+
+
+/*
+ * GPIO: every pin write reaches the simulated banks attached with
+ * kshim_gpio_attach(), through gpio_set_value() or through the GPSET0
+ * and GPCLR0 registers mapped by ioremap().
+ */
+
+struct gpio {
+  unsigned int  gpio;
+  unsigned long flags;
+  const char   *label;
+};
+
+#define GPIOF_DIR_OUT      0
+#define GPIOF_DIR_IN       1
+#define GPIOF_INIT_LOW     0
+#define GPIOF_INIT_HIGH    2
+#define GPIOF_IN           GPIOF_DIR_IN
+#define GPIOF_OUT_INIT_LOW ( GPIOF_DIR_OUT | GPIOF_INIT_LOW )
+#define GPIOF_OUT_INIT_HIGH ( GPIOF_DIR_OUT | GPIOF_INIT_HIGH )
+
+#define KSHIM_GPIO_NR 54
+
+static inline int gpio_is_valid ( int gpio ) { return gpio >= 0 && gpio < KSHIM_GPIO_NR; }
+static inline int gpio_cansleep ( unsigned int gpio ) { return 0; }
+
+int  gpio_request_array ( const struct gpio *array, size_t num );
+void gpio_free_array ( const struct gpio *array, size_t num );
+void gpio_set_value ( unsigned int gpio, int value );
+int  gpio_get_value ( unsigned int gpio );
+
+/*
+ * GPIO descriptors (4.3 and later): an array write changes all its
+ * lines in one update of the simulated banks, like the registers. The
+ * values are an int array up to 4.19, a bitmap from 4.20 on.
+ */
+
+struct gpio_desc;
+struct gpio_array;
+
+struct gpio_desc *gpio_to_desc ( unsigned int gpio );
+void gpiod_set_value ( struct gpio_desc *desc, int value );
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+int  gpiod_set_array_value ( unsigned int array_size, struct gpio_desc **desc_array,
+                             struct gpio_array *array_info, unsigned long *value_bitmap );
+#else
+void gpiod_set_array_value ( unsigned int array_size, struct gpio_desc **desc_array,
+                             int *value_array );
+#endif
+
+/* Base of the GPIO registers (mach/platform.h) */
+#define GPIO_BASE 0x20200000UL
+#define SZ_4K     0x1000
+
+void __iomem *ioremap ( unsigned long phys, unsigned long size );
+void iounmap ( volatile void __iomem *addr );
+void writel ( u32 value, volatile void __iomem *addr );
+u32  readl ( const volatile void __iomem *addr );
+
+/*
+ * Attach a simulated bank: it sees every change of the levels of the
+ * first 32 pins, in order. At most KSHIM_SIM_NR banks.
+ */
+
+#define KSHIM_SIM_NR 8
+
+int
+kshim_gpio_attach ( struct lcd_sim *sim );
+
+void
+kshim_gpio_detach_all ( void );
+
+#endif
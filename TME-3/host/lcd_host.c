@@ -0,0 +1,486 @@
+/*
+ * RpiLab: lab3
+ *
+ * Banc de test du pilote bcm2708_lcd sur la machine hôte : le source du
+ * pilote, compilé tel quel contre les en-têtes de host/, pilote les
+ * HD44780 simulés de liblcd. On mesure les chemins write() et ioctl(),
+ * on stresse le pilote avec plusieurs fils d'exécution, puis on vérifie
+ * que l'image de l'écran du pilote est bien ce qu'affiche le simulateur.
+ */
+
+#include "kshim.h"
+
+#include <unistd.h>
+
+#include "lcd_sim.h"
+#include "bcm2708_lcd.h"
+
+
+// Câblage des afficheurs simulés : RS, EN, puis D0-D3, tous dans le
+// premier banc. Le premier est celui de la carte de TP.
+static const int wiring[][6] = {
+  {18, 23,  4, 17, 27, 22},
+  { 5,  6, 12, 13, 16, 19},
+  {20, 21, 24, 25, 26,  7},
+  { 8,  9, 10, 11, 14, 15},
+};
+
+#define HOST_MAX_DISPLAYS ((int)ARRAY_SIZE(wiring))
+#define HOST_MAX_THREADS  8
+
+static struct lcd_sim *sims[HOST_MAX_DISPLAYS];
+static int displays = 1;
+static int threads = 2;
+static int iterations = 50;
+
+
+// Durées d'une série d'appels
+struct host_lat {
+  unsigned long n;
+  unsigned long long total, max;
+};
+
+static void lat_add(struct host_lat *l, unsigned long long us){
+  l->n++;
+  l->total += us;
+  if(us > l->max)
+    l->max = us;
+}
+
+static void lat_print(const char *name, const struct host_lat *l){
+  printf("  %-10s %6lu calls, avg %6llu us, max %7llu us\n", name, l->n,
+         l->n ? l->total / l->n : 0, l->max);
+}
+
+static unsigned long long now_us(void){
+  return ktime_get() / NSEC_PER_USEC;
+}
+
+
+
+// Paramètres du module pour "displays" afficheurs, et bancs simulés
+static int host_setup(void){
+  char rs[32] = "", en[32] = "", data[128] = "";
+  struct lcd_pins pins;
+  int i, j;
+
+  for(i=0;i<displays;i++){
+    snprintf(rs + strlen(rs), sizeof(rs) - strlen(rs), "%s%d", i ? "," : "", wiring[i][0]);
+    snprintf(en + strlen(en), sizeof(en) - strlen(en), "%s%d", i ? "," : "", wiring[i][1]);
+    for(j=0;j<4;j++)
+      snprintf(data + strlen(data), sizeof(data) - strlen(data), "%s%d",
+               i || j ? "," : "", wiring[i][2 + j]);
+
+    memset(&pins, 0, sizeof(pins));
+    pins.bus = LCD_BUS_4BIT;
+    pins.rs = wiring[i][0];
+    pins.en[0] = wiring[i][1];
+    for(j=0;j<4;j++)
+      pins.data[j] = wiring[i][2 + j];
+    pins.n = 1;
+
+    sims[i] = lcd_sim_create(&pins);
+    if(sims[i] == NULL || kshim_gpio_attach(sims[i]) == -1)
+      return -1;
+  }
+
+  if(kshim_param_set("rs", rs) == -1 || kshim_param_set("en", en) == -1 ||
+     kshim_param_set("data", data) == -1)
+    return -1;
+
+  return 0;
+}
+
+
+
+// Écrans complets : write() de 80 caractères, puis fsync()
+static void test_frame(struct file *f){
+  struct host_lat w = {0}, s = {0};
+  char text[BCM2708_LCD_CELLS + 1];
+  unsigned long long t;
+  int i;
+
+  for(i=0;i<iterations;i++){
+    snprintf(text, sizeof(text), "frame %-14d%-20s%-20s%-20d",
+             i, "host harness", "bcm2708_lcd", i * 7);
+    kshim_ioctl(f, BCM2708_LCD_IOCHOME, 0);
+
+    t = now_us();
+    kshim_write(f, text, BCM2708_LCD_CELLS);
+    lat_add(&w, now_us() - t);
+
+    t = now_us();
+    kshim_fsync(f);
+    lat_add(&s, now_us() - t);
+  }
+
+  printf("frame\n");
+  lat_print("write", &w);
+  lat_print("fsync", &s);
+}
+
+
+
+// Mises à jour de champs : un appel IOCSEGMENTS pour 4 champs
+static void test_segments(struct file *f){
+  struct bcm2708_lcd_segment seg[BCM2708_LCD_ROWS];
+  struct bcm2708_lcd_segments req;
+  struct host_lat l = {0}, s = {0};
+  unsigned long long t;
+  int i, row;
+
+  for(i=0;i<iterations;i++){
+    for(row=0;row<BCM2708_LCD_ROWS;row++){
+      seg[row].row = row;
+      seg[row].col = 14;
+      seg[row].len = 6;
+      snprintf(seg[row].text, sizeof(seg[row].text), "%6d", i * (row + 1));
+    }
+    req.n = BCM2708_LCD_ROWS;
+    req.segs = (unsigned long)seg;
+
+    t = now_us();
+    kshim_ioctl(f, BCM2708_LCD_IOCSEGMENTS, (unsigned long)&req);
+    lat_add(&l, now_us() - t);
+
+    t = now_us();
+    kshim_fsync(f);
+    lat_add(&s, now_us() - t);
+  }
+
+  printf("segments\n");
+  lat_print("ioctl", &l);
+  lat_print("fsync", &s);
+}
+
+
+
+// Lignes de l'image de l'écran du pilote (debugfs "screen")
+static int screen_rows(int display, char rows[BCM2708_LCD_ROWS][BCM2708_LCD_COLS + 1]){
+  char path[64], buf[512];
+  char *line;
+  int i;
+
+  snprintf(path, sizeof(path), "bcm2708_lcd/lcd%d/screen", display);
+  if(kshim_debugfs_read(path, buf, sizeof(buf)) < 0)
+    return -1;
+
+  line = strchr(buf, '\n');
+  for(i=0;i<BCM2708_LCD_ROWS;i++){
+    if(line == NULL)
+      return -1;
+    snprintf(rows[i], BCM2708_LCD_COLS + 1, "%.20s", line + 2);
+    line = strchr(line + 1, '\n');
+  }
+
+  return 0;
+}
+
+
+// Mode terminal : un journal de lignes qui défile, puis on remonte
+// dans l'historique. On compte les octets envoyés à l'afficheur.
+static int test_term(struct file *f){
+  char rows[BCM2708_LCD_ROWS][BCM2708_LCD_COLS + 1];
+  char want[64], text[64];
+  struct host_lat w = {0};
+  unsigned long strobes;
+  unsigned long long t;
+  int lines = iterations < 8 ? 8 : iterations;
+  int i, row, n, err = 0;
+
+  if(kshim_ioctl(f, BCM2708_LCD_IOCSTERM, 1) < 0)
+    return -1;
+
+  kshim_fsync(f);
+  strobes = sims[0]->disp[0].strobes;
+  for(i=0;i<lines;i++){
+    n = snprintf(text, sizeof(text), "log %4d: temp %2d.%d\n", i, 20 + i % 3, i % 10);
+    t = now_us();
+    kshim_write(f, text, n);
+    lat_add(&w, now_us() - t);
+  }
+  kshim_fsync(f);
+  strobes = sims[0]->disp[0].strobes - strobes;
+
+  // Les trois dernières lignes, et la ligne courante, vide
+  for(n=0;n<2 && !err;n++){
+    if(n == 1 && kshim_ioctl(f, BCM2708_LCD_IOCSCROLL, 2) != 2)
+      err = -1;
+    kshim_fsync(f);
+    if(screen_rows(0, rows) == -1)
+      return -1;
+    for(row=0;row<BCM2708_LCD_ROWS;row++){
+      i = lines - BCM2708_LCD_ROWS + 1 + row - 2 * n;
+      if(i < lines)
+        snprintf(want, sizeof(want), "log %4d: temp %2d.%d ", i, 20 + i % 3, i % 10);
+      else
+        snprintf(want, sizeof(want), "%20s", "");
+      if(strcmp(rows[row], want) != 0){
+        printf("term row %d: driver |%s|, expected |%s|\n", row, rows[row], want);
+        err = -1;
+      }
+    }
+  }
+
+  kshim_ioctl(f, BCM2708_LCD_IOCSTERM, 0);
+
+  printf("term: %d lines, %lu strobes (%.1f per line)\n", lines, strobes,
+         (double)strobes / lines);
+  lat_print("write", &w);
+  return err;
+}
+
+
+
+// Deux fichiers, une ligne chacun : un "Clear" brut envoyé par l'un
+// n'efface que sa région, l'autre est réécrite sur l'afficheur. Puis le
+// curseur rendu par BCM2708_LCD_IOCGCURPOS
+static int test_clear(void){
+  char rows[BCM2708_LCD_ROWS][BCM2708_LCD_COLS + 1], row[LCD_COLS + 1];
+  static const char *text[2] = {"clear: kept         ", "clear: erased       "};
+  struct bcm2708_lcd_region r = {0, 0, 1, BCM2708_LCD_COLS};
+  struct file *f[2];
+  int i, err = 0;
+
+  for(i=0;i<2;i++){
+    f[i] = kshim_open(0, 0);
+    if(f[i] == NULL)
+      return -1;
+    r.row = i;
+    kshim_ioctl(f[i], BCM2708_LCD_IOCSREGION, (unsigned long)&r);
+    kshim_write(f[i], text[i], BCM2708_LCD_COLS);
+    kshim_fsync(f[i]);
+  }
+
+  kshim_ioctl(f[1], BCM2708_LCD_IOCCMD, 0x01);
+  kshim_fsync(f[1]);
+
+  if(screen_rows(0, rows) == -1)
+    err = -1;
+  for(i=0;i<2 && !err;i++){
+    lcd_sim_row(&sims[0]->disp[0], i, row);
+    if(strcmp(rows[i], i ? "                    " : text[0]) != 0 ||
+       strcmp(row, rows[i]) != 0){
+      printf("clear row %d: driver |%s|, display |%s|\n", i, rows[i], row);
+      err = -1;
+    }
+  }
+
+  // Curseur du second fichier : ligne 1, après "ab"
+  kshim_write(f[1], "ab", 2);
+  if(kshim_ioctl(f[1], BCM2708_LCD_IOCGCURPOS, (unsigned long)&i) != 0 ||
+     i != BCM2708_LCD_COLS + 2){
+    printf("clear: cursor %d, expected %d\n", i, BCM2708_LCD_COLS + 2);
+    err = -1;
+  }
+
+  for(i=0;i<2;i++)
+    kshim_close(f[i]);
+
+  printf("clear: %s\n", err ? "errors" : "ok");
+  return err;
+}
+
+
+
+// Stress : plusieurs fils par afficheur, chacun dans sa région (une
+// ligne), qui écrivent sans attendre l'afficheur ; le dernier efface
+// et remet le curseur au début de temps en temps
+struct host_worker {
+  pthread_t thread;
+  int display, row;
+  struct host_lat lat;
+  int err;
+};
+
+static void *stress_thread(void *arg){
+  struct host_worker *w = arg;
+  struct bcm2708_lcd_region r;
+  char text[BCM2708_LCD_COLS + 1];
+  unsigned long long t;
+  struct file *f;
+  ssize_t n;
+  int i;
+
+  f = kshim_open(w->display, 0);
+  if(f == NULL){
+    w->err = 1;
+    return NULL;
+  }
+
+  r.row = w->row;
+  r.col = 0;
+  r.rows = 1;
+  r.cols = BCM2708_LCD_COLS;
+  if(kshim_ioctl(f, BCM2708_LCD_IOCSREGION, (unsigned long)&r) < 0)
+    w->err = 1;
+
+  for(i=0;i<iterations && !w->err;i++){
+    snprintf(text, sizeof(text), "d%d r%d %-14d", w->display, w->row, i);
+
+    if(i % 16 == 15)
+      kshim_ioctl(f, BCM2708_LCD_IOCCLEAR, 0);
+    else
+      kshim_ioctl(f, BCM2708_LCD_IOCHOME, 0);
+
+    t = now_us();
+    n = kshim_write(f, text, BCM2708_LCD_COLS);
+    lat_add(&w->lat, now_us() - t);
+    if(n != BCM2708_LCD_COLS)
+      w->err = 1;
+  }
+
+  kshim_fsync(f);
+  kshim_close(f);
+  return NULL;
+}
+
+
+static int test_stress(void){
+  struct host_worker w[HOST_MAX_DISPLAYS * HOST_MAX_THREADS];
+  struct host_lat all = {0};
+  unsigned long long t;
+  int i, n = 0, err = 0;
+
+  t = now_us();
+  for(i=0;i<displays*threads;i++){
+    memset(&w[i], 0, sizeof(w[i]));
+    w[i].display = i / threads;
+    w[i].row = (i % threads) % BCM2708_LCD_ROWS;
+    if(pthread_create(&w[i].thread, NULL, stress_thread, &w[i]) != 0)
+      break;
+    n++;
+  }
+
+  for(i=0;i<n;i++){
+    pthread_join(w[i].thread, NULL);
+    err |= w[i].err;
+    all.n += w[i].lat.n;
+    all.total += w[i].lat.total;
+    if(w[i].lat.max > all.max)
+      all.max = w[i].lat.max;
+  }
+
+  printf("stress: %d displays, %d threads each, %llu ms\n", displays, threads,
+         (now_us() - t) / 1000);
+  lat_print("write", &all);
+
+  return err || n != displays * threads ? -1 : 0;
+}
+
+
+
+// L'image de l'écran du pilote (debugfs "screen") est-elle ce
+// qu'affiche le contrôleur simulé ?
+static int check(int display){
+  char path[64], buf[512], row[LCD_COLS + 1];
+  struct lcd_sim_display *d = &sims[display]->disp[0];
+  struct file *f;
+  char *line;
+  int i, err = 0;
+
+  f = kshim_open(display, 0);
+  if(f == NULL)
+    return -1;
+  kshim_fsync(f);
+  kshim_close(f);
+
+  snprintf(path, sizeof(path), "bcm2708_lcd/lcd%d/screen", display);
+  if(kshim_debugfs_read(path, buf, sizeof(buf)) < 0)
+    return -1;
+
+  line = strchr(buf, '\n');
+  for(i=0;i<LCD_ROWS && line != NULL;i++){
+    lcd_sim_row(d, i, row);
+    if(strncmp(line + 2, row, LCD_COLS) != 0){
+      printf("lcd%d row %d: driver |%.20s|, display |%s|\n", display, i,
+             line + 2, row);
+      err = -1;
+    }
+    line = strchr(line + 1, '\n');
+  }
+
+  if(d->violations > 0){
+    printf("lcd%d: %lu bytes sent while the controller was busy\n",
+           display, d->violations);
+    err = -1;
+  }
+
+  printf("lcd%d: %s (%lu strobes)\n", display, err ? "MISMATCH" : "ok", d->strobes);
+  return err;
+}
+
+
+static void stats(int display){
+  char path[64], buf[2048];
+
+  snprintf(path, sizeof(path), "bcm2708_lcd/lcd%d/stats", display);
+  if(kshim_debugfs_read(path, buf, sizeof(buf)) >= 0)
+    printf("lcd%d stats:\n%s", display, buf);
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr, "usage: %s [-n displays] [-t threads] [-i iterations] [-v]\n", name);
+  exit(2);
+}
+
+
+// Fonction principale
+int main(int argc, char *argv[]){
+  struct file *f;
+  int opt, i, err = 0;
+
+  while((opt = getopt(argc, argv, "n:t:i:v")) != -1){
+    switch(opt){
+    case 'n': displays = atoi(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 'i': iterations = atoi(optarg); break;
+    case 'v': kshim_verbose = 1; break;
+    default:  usage(argv[0]);
+    }
+  }
+  if(displays < 1 || displays > HOST_MAX_DISPLAYS ||
+     threads < 1 || threads > HOST_MAX_THREADS || iterations < 1)
+    usage(argv[0]);
+
+  if(host_setup() == -1 || kshim_load() != 0){
+    fprintf(stderr, "cannot load the module\n");
+    return 1;
+  }
+
+  f = kshim_open(0, 0);
+  if(f == NULL){
+    fprintf(stderr, "cannot open lcd0\n");
+    return 1;
+  }
+  test_frame(f);
+  test_segments(f);
+  if(test_term(f) == -1){
+    printf("term: errors\n");
+    err = 1;
+  }
+  kshim_close(f);
+
+  if(test_clear() == -1)
+    err = 1;
+
+  if(test_stress() == -1){
+    printf("stress: errors\n");
+    err = 1;
+  }
+
+  for(i=0;i<displays;i++){
+    if(check(i) == -1)
+      err = 1;
+    stats(i);
+  }
+
+  kshim_unload();
+  kshim_gpio_detach_all();
+  for(i=0;i<displays;i++)
+    lcd_sim_destroy(sims[i]);
+
+  return err;
+}
@@ -0,0 +1,2 @@
+/* Host build of bcm2708_lcd: see ../../kshim.h */
+#include "../../kshim.h"
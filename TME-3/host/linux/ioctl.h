@@ -0,0 +1,3 @@
+/* Host build of bcm2708_lcd: see ../kshim.h */
+#include_next <linux/ioctl.h>
+#include "../kshim.h"
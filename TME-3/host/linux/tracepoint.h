@@ -0,0 +1,14 @@
+/* Host build of bcm2708_lcd: see ../kshim.h */
+#include "../kshim.h"
+
+/* The events are empty functions: there is no ftrace on the host */
+#ifndef _KSHIM_TRACEPOINT_H_
+#define _KSHIM_TRACEPOINT_H_
+
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...)  args
+
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+  static inline void trace_##name ( proto ) { }
+
+#endif
@@ -0,0 +1,2 @@
+/* Host build of bcm2708_lcd: see ../kshim.h. The events are defined by
+   linux/tracepoint.h, there is nothing to instantiate. */
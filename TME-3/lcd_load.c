@@ -0,0 +1,392 @@
+/*
+ * RpiLab: lab3
+ *
+ * Générateur de charge pour /dev/bcm2708_lcd : plusieurs processus, et
+ * plusieurs fils d'exécution par processus, ouvrent chacun le
+ * périphérique et envoient un mélange de mises à jour courtes (un
+ * segment), d'écrans complets (write()) et d'effacements. On mesure la
+ * latence de chaque opération et le débit obtenu.
+ *
+ * Un fil sonde se réveille périodiquement sur le même processeur et
+ * mesure le retard de ses réveils : les sections du pilote qui ne
+ * rendent pas la main (verrou tournant, udelay) y apparaissent. Avec
+ * "-t 0", seule la sonde tourne : c'est la référence à vide.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bcm2708_lcd.h"
+
+
+// Opérations du mélange
+#define OP_STATUS 0   // un segment de 12 caractères (BCM2708_LCD_IOCSEGMENTS)
+#define OP_FRAME  1   // "Home" puis l'écran complet par write()
+#define OP_CLEAR  2   // BCM2708_LCD_IOCCLEAR
+#define OP_NR     3
+
+static const char *op_name[] = {"status", "frame", "clear"};
+
+
+// Histogramme des durées par puissance de deux de microsecondes, comme
+// celui du pilote : la case i compte [2^i, 2^(i+1)) us, la case 0 aussi
+// les plus courtes et la dernière les plus longues
+#define HIST_NR 24
+
+struct hist {
+  unsigned long count[HIST_NR];
+  unsigned long long total, max;
+};
+
+// Résultats d'un fil d'exécution, dans une zone partagée entre les
+// processus : chaque fil a la sienne, sans verrou
+struct stats {
+  struct hist op[OP_NR];
+  unsigned long errors[OP_NR];
+  int failed;                   // le périphérique n'a pas pu être ouvert
+};
+
+
+static const char *dev = "/dev/bcm2708_lcd";
+static int procs = 1;
+static int threads = 2;
+static int seconds = 5;
+static int weight[OP_NR] = {8, 1, 1};
+static int interval = 0;        // us entre deux opérations d'un fil (0 : sans pause)
+static int sync_ops = 0;        // fsync() après chaque opération
+static int cpu = -1;            // processeur imposé à tous (-1 : aucun)
+static int period = 1000;       // période de la sonde, en us
+static unsigned int seed = 1;
+
+static unsigned long long stop_at;
+static struct stats *results;   // un par fil de charge
+static struct hist late;        // retard des réveils de la sonde
+
+
+
+// Date courante en nanosecondes
+static unsigned long long now_ns(void){
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+static void hist_add(struct hist *h, unsigned long long ns){
+  unsigned long long us = ns / 1000;
+  int i = 0;
+
+  while(us > 1 && i < HIST_NR - 1){
+    us >>= 1;
+    i++;
+  }
+
+  h->count[i]++;
+  h->total += ns;
+  if(ns > h->max)
+    h->max = ns;
+}
+
+
+static void hist_merge(struct hist *h, const struct hist *from){
+  int i;
+
+  for(i=0;i<HIST_NR;i++)
+    h->count[i] += from->count[i];
+  h->total += from->total;
+  if(from->max > h->max)
+    h->max = from->max;
+}
+
+
+static unsigned long hist_count(const struct hist *h){
+  unsigned long n = 0;
+  int i;
+
+  for(i=0;i<HIST_NR;i++)
+    n += h->count[i];
+  return n;
+}
+
+
+// Borne supérieure (us) de la case qui contient le quantile "q"
+static unsigned long hist_quantile(const struct hist *h, double q){
+  unsigned long n = hist_count(h), sum = 0;
+  int i;
+
+  for(i=0;i<HIST_NR-1;i++){
+    sum += h->count[i];
+    if(sum >= q * n)
+      break;
+  }
+  return 2ul << i;
+}
+
+
+static void hist_print(const char *name, const struct hist *h, double rate,
+                       unsigned long errors){
+  unsigned long n = hist_count(h);
+  char p50[16], p99[16];
+  int i;
+
+  snprintf(p50, sizeof(p50), "<%lu", hist_quantile(h, 0.5));
+  snprintf(p99, sizeof(p99), "<%lu", hist_quantile(h, 0.99));
+  printf("%-8s %8lu %9.1f %7lu %8llu %8s %8s %9llu\n", name, n, rate,
+         errors, n ? h->total / n / 1000 : 0, n ? p50 : "-", n ? p99 : "-",
+         h->max / 1000);
+  for(i=0;i<HIST_NR;i++){
+    if(h->count[i] > 0)
+      printf("  %s%8lu us: %lu\n", i == HIST_NR - 1 ? ">=" : "< ",
+             i == HIST_NR - 1 ? 1ul << i : 2ul << i, h->count[i]);
+  }
+}
+
+
+
+// Une opération tirée au hasard selon les poids du mélange
+static int pick_op(unsigned int *r){
+  int total = weight[OP_STATUS] + weight[OP_FRAME] + weight[OP_CLEAR];
+  int x = rand_r(r) % total;
+  int op;
+
+  for(op=0;op<OP_NR-1;op++){
+    if(x < weight[op])
+      break;
+    x -= weight[op];
+  }
+  return op;
+}
+
+
+// Exécute l'opération "op" ; rend -1 si un appel échoue
+static int run_op(int fd, int op, int id, unsigned long i){
+  struct bcm2708_lcd_segments segs;
+  struct bcm2708_lcd_segment seg;
+  char screen[BCM2708_LCD_CELLS];
+  char text[BCM2708_LCD_COLS + 1];
+
+  switch(op){
+  case OP_STATUS:
+    snprintf(text, sizeof(text), "%02d %9lu", id % 100, i % 1000000000);
+    seg.row = id % BCM2708_LCD_ROWS;
+    seg.col = 0;
+    seg.len = 12;
+    memcpy(seg.text, text, seg.len);
+    segs.n = 1;
+    segs.segs = (unsigned long)&seg;
+    return ioctl(fd, BCM2708_LCD_IOCSEGMENTS, &segs) < 0 ? -1 : 0;
+  case OP_FRAME:
+    memset(screen, 'a' + (id + i) % 26, sizeof(screen));
+    if(ioctl(fd, BCM2708_LCD_IOCHOME) < 0)
+      return -1;
+    return write(fd, screen, sizeof(screen)) != sizeof(screen) ? -1 : 0;
+  default:
+    return ioctl(fd, BCM2708_LCD_IOCCLEAR) < 0 ? -1 : 0;
+  }
+}
+
+
+
+// Fil de charge : son propre fichier ouvert, et une graine propre pour
+// que le mélange soit reproductible
+static void *worker(void *arg){
+  int id = (long)arg;
+  struct stats *s = &results[id];
+  unsigned long long t0, next;
+  unsigned int r = seed + id;
+  unsigned long i;
+  int fd, op;
+
+  fd = open(dev, O_WRONLY);
+  if(fd < 0){
+    perror(dev);
+    s->failed = 1;
+    return NULL;
+  }
+
+  next = now_ns();
+  for(i=0;(t0 = now_ns()) < stop_at;i++){
+    op = pick_op(&r);
+    if(run_op(fd, op, id, i) == -1 || (sync_ops && fsync(fd) < 0))
+      s->errors[op]++;
+    hist_add(&s->op[op], now_ns() - t0);
+
+    if(interval > 0){
+      next += interval * 1000ull;
+      while(now_ns() < next)
+        usleep((next - now_ns()) / 1000);
+    }
+  }
+
+  close(fd);
+  return NULL;
+}
+
+
+
+// Sonde : réveils périodiques à date absolue, on mesure leur retard
+static void *probe(void *arg){
+  struct timespec ts;
+  unsigned long long target;
+
+  for(target=now_ns()+period*1000ull;target<stop_at;target+=period*1000ull){
+    ts.tv_sec = target / 1000000000;
+    ts.tv_nsec = target % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    hist_add(&late, now_ns() - target);
+  }
+  return NULL;
+}
+
+
+
+// Processus de charge numéro "p" : "threads" fils
+static void run_proc(int p){
+  pthread_t tid[threads];
+  int i;
+
+  for(i=0;i<threads;i++)
+    pthread_create(&tid[i], NULL, worker, (void *)(long)(p * threads + i));
+  for(i=0;i<threads;i++)
+    pthread_join(tid[i], NULL);
+}
+
+
+
+static void usage(const char *name){
+  fprintf(stderr,
+          "usage: %s [-d device] [-p processes] [-t threads] [-s seconds]\n"
+          "          [-m status,frame,clear] [-i interval us] [-y] [-c cpu]\n"
+          "          [-P probe period us] [-r seed]\n"
+          "  -m: weights of the operations (default 8,1,1)\n"
+          "  -y: fsync() after each operation, to wait for the display\n"
+          "  -c: run every thread, and the probe, on this CPU\n",
+          name);
+  exit(1);
+}
+
+
+
+// Fonction principale
+int main ( int argc, char *argv[] )
+{
+  struct stats total;
+  pthread_t probe_tid;
+  unsigned long long start;
+  double elapsed;
+  cpu_set_t set;
+  int n, opt, i, op;
+
+  while((opt = getopt(argc, argv, "d:p:t:s:m:i:yc:P:r:")) != -1){
+    switch(opt){
+    case 'd': dev = optarg; break;
+    case 'p': procs = atoi(optarg); break;
+    case 't': threads = atoi(optarg); break;
+    case 's': seconds = atoi(optarg); break;
+    case 'm':
+      if(sscanf(optarg, "%d,%d,%d", &weight[OP_STATUS], &weight[OP_FRAME],
+                &weight[OP_CLEAR]) != 3)
+        usage(argv[0]);
+      break;
+    case 'i': interval = atoi(optarg); break;
+    case 'y': sync_ops = 1; break;
+    case 'c': cpu = atoi(optarg); break;
+    case 'P': period = atoi(optarg); break;
+    case 'r': seed = strtoul(optarg, NULL, 0); break;
+    default: usage(argv[0]);
+    }
+  }
+
+  if(procs < 1 || threads < 0 || seconds < 1 || period < 1 || interval < 0 ||
+     weight[OP_STATUS] < 0 || weight[OP_FRAME] < 0 || weight[OP_CLEAR] < 0 ||
+     weight[OP_STATUS] + weight[OP_FRAME] + weight[OP_CLEAR] == 0)
+    usage(argv[0]);
+
+  // Les processus et les fils héritent du processeur imposé
+  if(cpu >= 0){
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(sched_setaffinity(0, sizeof(set), &set) < 0){
+      perror("sched_setaffinity");
+      return 1;
+    }
+  }
+
+  n = procs * threads;
+  results = mmap(NULL, (n > 0 ? n : 1) * sizeof(*results), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(results == MAP_FAILED){
+    perror("mmap");
+    return 1;
+  }
+
+  start = now_ns();
+  stop_at = start + seconds * 1000000000ull;
+
+  for(i=0;i<procs && threads>0;i++){
+    switch(fork()){
+    case -1:
+      perror("fork");
+      stop_at = 0;
+      break;
+    case 0:
+      run_proc(i);
+      _exit(0);
+    }
+  }
+
+  pthread_create(&probe_tid, NULL, probe, NULL);
+  pthread_join(probe_tid, NULL);
+  while(wait(NULL) > 0)
+    ;
+  elapsed = (now_ns() - start) / 1e9;
+
+  memset(&total, 0, sizeof(total));
+  for(i=0;i<n;i++){
+    for(op=0;op<OP_NR;op++){
+      hist_merge(&total.op[op], &results[i].op[op]);
+      total.errors[op] += results[i].errors[op];
+    }
+    total.failed += results[i].failed;
+  }
+
+  printf("device %s, %d process(es) x %d thread(s), mix %d,%d,%d, %s%.1f s",
+         dev, procs, threads, weight[OP_STATUS], weight[OP_FRAME],
+         weight[OP_CLEAR], sync_ops ? "fsync, " : "", elapsed);
+  if(cpu >= 0)
+    printf(", cpu %d", cpu);
+  printf("\n%-8s %8s %9s %7s %8s %8s %8s %9s\n", "op", "calls", "ops/s",
+         "errors", "avg", "p50", "p99", "max(us)");
+
+  for(op=0;op<OP_NR;op++){
+    hist_print(op_name[op], &total.op[op], hist_count(&total.op[op]) / elapsed,
+               total.errors[op]);
+  }
+  if(total.failed > 0)
+    printf("%d thread(s) could not open %s\n", total.failed, dev);
+
+  // Retard des réveils de la sonde : ce que subit un autre fil du même
+  // processeur pendant la charge
+  printf("probe, period %d us:\n", period);
+  hist_print("late", &late, hist_count(&late) / elapsed, 0);
+
+  for(op=0;op<OP_NR;op++)
+    total.failed += total.errors[op] > 0;
+  return total.failed > 0;
+}